@@ -1,8 +1,46 @@
 #include "shell.h"
 #include "vero.h"
 
-int main() {
+int main(int argc, char* argv[]) {
+    // options come before the first file, everything after a script is its arguments
+    bool compile = false;
+    int first_file = argc;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--ast") {
+            use_ast_interpreter = true;
+        } else if (std::string(argv[i]) == "--compile") {
+            compile = true;
+        } else if (std::string(argv[i]) == "--report-optimizations") {
+            // lists each constant folded and branch removed before a script runs
+            report_optimizations = true;
+        } else if (std::string(argv[i]) == "--buffer-size" && i + 1 < argc) {
+            // bytes of output held before writing it, 0 writes every print straight away
+            output_buffer.capacity = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            first_file = i;
+            break;
+        }
+    }
     initialize_global_symbol_table();
+
+    // vero --compile file.vero ... writes file.veroc, an image that run() loads without parsing
+    if (compile) {
+        int status = 0;
+        for (int i = first_file; i < argc; i++) {
+            Error* error = precompile(argv[i]);
+            if (error != nullptr) {
+                std::cout << error->as_string() << std::endl;
+                status = 1;
+            }
+        }
+        return status;
+    }
+
+    // vero script.vero [args] runs the whole file at once instead of starting the shell
+    if (first_file < argc) {
+        return run_file(argv[first_file], std::vector<std::string>(argv + first_file + 1, argv + argc));
+    }
+
     std::string statement;
     while (true) {
         std::cout << ">>> ";
@@ -14,13 +52,14 @@ int main() {
             continue;
         }
         std::pair result = run("<stdin>", statement);
-        Value* value = result.first;
+        output_buffer.flush();
+        Value value = result.first;
         Error* error = result.second;
 
-        if (error->err_name != "" && error->err_name != "EOF") {
+        if (error != nullptr) {
             std::cout << error->as_string() << std::endl;
         } else {
-            std::string out_value = value->repr();
+            std::string out_value = value.repr();
             // Split output by newlines
             size_t pos = 0;
             size_t last_pos = 0;
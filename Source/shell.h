@@ -3,5 +3,6 @@
 
 #include <iostream>
 #include <string>
+#include <cstdlib>
 
 #endif
\ No newline at end of file
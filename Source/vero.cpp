@@ -4,38 +4,18 @@
 
 const std::vector<char> DIGITS = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9'};
 
-std::string INT_TOKEN = "INT";
-std::string FLOAT_TOKEN = "FLOAT";
-std::string STRING_TOKEN = "STRING";
-std::string PLUS_TOKEN = "PLUS";
-std::string MINUS_TOKEN = "MINUS";
-std::string POWER_TOKEN = "POW";
-std::string MUL_TOKEN = "MUL";
-std::string DIV_TOKEN = "DIV";
-std::string LPAREN_TOKEN = "LPAREN";
-std::string RPAREN_TOKEN = "RPAREN";
-std::string LSQUARE_TOKEN = "LSQUARE";
-std::string RSQUARE_TOKEN = "RSQUARE";
-std::string LBRACE_TOKEN = "LBRACE";
-std::string RBRACE_TOKEN = "RBRACE";
-std::string EOF_TOKEN = "EOF";
-std::string IDENTIFIER_TOKEN = "IDENTIFIER";
-std::string EQUALS_TOKEN = "EQUALS";
-std::string KEYWORD_TOKEN = "KEYWORD";
-std::string EE_TOKEN = "EE";
-std::string NE_TOKEN = "NE";
-std::string LT_TOKEN = "LT";
-std::string GT_TOKEN = "GT";
-std::string LTE_TOKEN = "LTE";
-std::string GTE_TOKEN = "GTE";
-std::string COMMA_TOKEN = "COMMA";
-std::string ARROW_TOKEN = "ARROW";
-std::string NEWLINE_TOKEN = "NEWLINE";
-
-Number* null_ = new Number(static_cast<int64_t>(0));
-Number* false_ = new Number(static_cast<int64_t>(0));
-Number* true_ = new Number(static_cast<int64_t>(0));
-Number* pi_ = new Number(3.14159265358979323846);
+// names of the token types, as shown by Token::repr
+const char* TOKEN_NAMES[] = {
+    "", "INT", "FLOAT", "STRING", "PLUS", "MINUS", "POW", "MUL", "DIV",
+    "LPAREN", "RPAREN", "LSQUARE", "RSQUARE", "LBRACE", "RBRACE", "EOF",
+    "IDENTIFIER", "EQUALS", "KEYWORD", "EE", "NE", "LT", "GT", "LTE", "GTE",
+    "COMMA", "ARROW", "NEWLINE"
+};
+
+Value null_ = Value(static_cast<int64_t>(0));
+Value false_ = Value(static_cast<int64_t>(0));
+Value true_ = Value(static_cast<int64_t>(0));
+Value pi_ = Value(3.14159265358979323846);
 
 bool is_digit(char c) {
     for (int i = 0; i < 10; i++) {
@@ -60,27 +40,24 @@ std::vector<std::string> KEYWORDS = {
     "elif", "else", "for", 
     "to", "step", "while", 
     "func", "null", "true", 
-    "false", "print", "input", 
-    "input_int", "clear", "is_number", 
-    "is_string", "is_list", "is_function", 
-    "append", "pop", "extend", 
-    "pi", "end", "return",
-    "continue", "break", "len", "run"
+    "false", "pi", "end",
+    "return", "continue", "break"
 }; 
-bool is_keyword(std::string id) {
-    for (int i = 0; i < KEYWORDS.size(); i++) {
-        if (id == KEYWORDS[i]) {
-            return true;
-        }
-    }
-    return false;
+// The names of the built-ins in BUILTIN_FUNCTIONS are keywords as well
+bool is_keyword(std::string_view id) {
+    static const std::unordered_set<std::string_view> keywords = [] {
+        std::unordered_set<std::string_view> keywords(KEYWORDS.begin(), KEYWORDS.end());
+        keywords.insert(builtin_names().begin(), builtin_names().end());
+        return keywords;
+    }();
+    return keywords.count(id) != 0;
 }
 
 // ************TOKENS************
 
-Token::Token() : type(""), value(""), pos_start(Position()), pos_end(Position()) {}
+Token::Token() : type(NO_TOKEN), value(""), pos_start(Position()), pos_end(Position()) {}
 
-Token::Token(std::string type, std::string value, Position* pos_start, Position* pos_end) {
+Token::Token(TokenType type, std::string_view value, Position* pos_start, Position* pos_end) {
     this->type = type;
     this->value = value;
     if (pos_start != nullptr) {
@@ -93,15 +70,15 @@ Token::Token(std::string type, std::string value, Position* pos_start, Position*
     }
 }
 
-bool Token::matches(std::string type_, std::string value_) {
+bool Token::matches(TokenType type_, std::string_view value_) const {
     return type == type_ && value == value_;
 }
 
 std::string Token::repr() const {
-    if (value != "") {
-        return type + ":" + value;
+    if (!value.empty()) {
+        return TOKEN_NAMES[type] + (":" + std::string(type == STRING_TOKEN ? string_value(value) : value));
     } else {
-        return type;
+        return TOKEN_NAMES[type];
     }
 }
 
@@ -112,9 +89,11 @@ std::ostream& operator<<(std::ostream& os, const Token& obj) {
 
 // ************LEXER************
 
-Lexer::Lexer(std::string file_name, std::string text) : file_name(file_name), text(text), pos(Position(-1, 0, -1, file_name, text)) {
-    this->file_name = file_name;
-    this->text = text;
+Lexer::Lexer(std::string file_name, std::string text) : Lexer(register_source_file(file_name, text)) {}
+
+Lexer::Lexer(int file_id) : file_name(source_file(file_id).name), file_id(file_id) {
+    this->text = source_file(file_id).text;
+    this->pos = Position(-1, file_id);
     advance();
 }
 
@@ -131,7 +110,7 @@ std::pair<std::vector<Token>, Error*> Lexer::make_tokens() { // TOKENIZATION FUN
     std::vector<Token> tokens;
 
     while (current_char != '\0') {
-        if (current_char == ' ' || current_char == '\t') {
+        if (current_char == ' ' || current_char == '\t' || current_char == '\r') {
             advance();
         } else if (current_char == '#') {
             skip_comment();
@@ -182,7 +161,7 @@ std::pair<std::vector<Token>, Error*> Lexer::make_tokens() { // TOKENIZATION FUN
             advance();
         } else if (current_char == '!') {
             std::pair<Token, Error*> res_of_mne = make_not_equals();
-            if (res_of_mne.second->err_name != "") {
+            if (res_of_mne.second != nullptr) {
                 return std::pair<std::vector<Token>, Error*>(std::vector<Token>(), res_of_mne.second);
             }
             tokens.push_back(res_of_mne.first);
@@ -204,7 +183,7 @@ std::pair<std::vector<Token>, Error*> Lexer::make_tokens() { // TOKENIZATION FUN
     }
 
     tokens.push_back(Token(EOF_TOKEN, "", &pos));
-    return std::pair<std::vector<Token>, Error*>(tokens, new Error(Position(-1, -1, -1, file_name, text), Position(-1, -1, -1, file_name, text), EOF_TOKEN, ""));
+    return std::pair<std::vector<Token>, Error*>(tokens, nullptr);
 }
 
 Token Lexer::make_minus_or_arrow() {
@@ -219,7 +198,6 @@ Token Lexer::make_minus_or_arrow() {
 }
 
 Token Lexer::make_number() { // NUMBER TOKENIZATION FUNCTION
-    std::string num = "";
     int dot_count = 0;
     Position pos_start = pos.copy();
 
@@ -229,12 +207,10 @@ Token Lexer::make_number() { // NUMBER TOKENIZATION FUNCTION
                 break;
             }
             dot_count++;
-            num = num + ".";
-        } else {
-            num = num + current_char;
         }
         advance();
     }
+    std::string_view num = text.substr(pos_start.index, pos.index - pos_start.index);
 
     if (dot_count == 0) {
         return Token(INT_TOKEN, num, &pos_start, &pos);
@@ -244,14 +220,13 @@ Token Lexer::make_number() { // NUMBER TOKENIZATION FUNCTION
 }
 
 Token Lexer::make_identifier() { // IDENTIFIER TOKENIZATION FUNCTION
-    std::string id = "";
     Position pos_start = pos.copy();
 
     while (current_char != '\0' && is_letter_or_digit(current_char)) {
-        id = id + current_char;
         advance();
     }
-    std::string type = ""; 
+    std::string_view id = text.substr(pos_start.index, pos.index - pos_start.index);
+    TokenType type; 
     if (is_keyword(id)) {
         type = KEYWORD_TOKEN;
     } else {
@@ -262,17 +237,30 @@ Token Lexer::make_identifier() { // IDENTIFIER TOKENIZATION FUNCTION
 }
 
 Token Lexer::make_string() { // STRING TOKENIZATION FUNCTION
-    std::string str = "";
     Position pos_start = pos.copy();
-    bool escape_character = false;
     advance();
 
+    while (current_char != '\0' && current_char != '"') {
+        advance(); 
+    }
+    std::string_view str = text.substr(pos_start.index + 1, pos.index - pos_start.index - 1);
+
+    advance();
+
+    return Token(STRING_TOKEN, str, &pos_start, &pos);
+}
+
+// Processes the escapes in the raw text of a string literal
+std::string string_value(std::string_view raw) {
+    std::string str = "";
+    bool escape_character = false;
+
     std::map<char, char> escape_characters = {
         {'n', '\n'},
         {'t', '\t'}
     };
 
-    while (current_char != '\0' && (current_char != '"' or escape_character)) {
+    for (char current_char : raw) {
         if (escape_character) {
             if (escape_characters.find(current_char) != escape_characters.end()) {
                 str += escape_characters[current_char];
@@ -286,13 +274,9 @@ Token Lexer::make_string() { // STRING TOKENIZATION FUNCTION
                 str += current_char;
             }
         }
-        advance(); 
         escape_character = false;
     }
-
-    advance();
-
-    return Token(STRING_TOKEN, str, &pos_start, &pos);
+    return str;
 }
 
 std::pair<Token, Error*> Lexer::make_not_equals() {
@@ -300,7 +284,7 @@ std::pair<Token, Error*> Lexer::make_not_equals() {
     advance();
     if (current_char == '=') {
         advance();
-        return std::pair<Token, Error*>(Token(NE_TOKEN, "", &pos_start, &pos), new Error(Position(), Position(), "", ""));
+        return std::pair<Token, Error*>(Token(NE_TOKEN, "", &pos_start, &pos), nullptr);
     } else {
         Position start = pos.copy();
         advance();
@@ -348,30 +332,124 @@ void Lexer::skip_comment() {
     }
 }
 
-// ************POSITION************
+// ************SOURCE FILES************
 
-Position::Position() : index(0), line(0), col(0), file_name(""), file_text("") {}
+std::vector<SourceFile*> source_files = {new SourceFile("", "")}; // nullptr where a file was freed
+std::vector<int> free_source_ids;
+std::unordered_multimap<uint64_t, int> source_index; // ids by hash
 
-Position::Position(int index, int line, int col, std::string file_name, std::string file_text) {
-    this->index = index;
-    this->line = line;
-    this->col = col;
-    this->file_name = file_name;
-    this->file_text = file_text;
+SourceFile::SourceFile(std::string name, std::string text) : name(name), text(text) {
+    line_starts.push_back(0);
+    for (size_t i = 0; i < this->text.length(); i++) {
+        if (this->text[i] == '\n') {
+            line_starts.push_back(i + 1);
+        }
+    }
 }
 
-void Position::advance(char current_char) {
-    index++;
-    col++;
+int SourceFile::line_at(int index) const {
+    if (index < 0) {
+        return 0;
+    }
+    return std::upper_bound(line_starts.begin(), line_starts.end(), index) - line_starts.begin() - 1;
+}
 
-    if (current_char == '\n') {
-        line++;
-        col = 0;
+int SourceFile::col_at(int index) const {
+    if (index < 0) {
+        return 0;
     }
+    return index - line_starts[line_at(index)];
+}
+
+std::string SourceFile::line_text(int line) const {
+    if (line < 0 || static_cast<size_t>(line) >= line_starts.size() || static_cast<size_t>(line_starts[line]) >= text.length()) {
+        return "";
+    }
+    size_t end = text.find('\n', line_starts[line]);
+    if (end == std::string::npos) {
+        end = text.length();
+    }
+    return text.substr(line_starts[line], end - line_starts[line]);
+}
+
+int register_source_file(std::string file_name, std::string file_text) {
+    // re-running an unchanged file (or REPL line) that is still held reuses its entry
+    uint64_t hash = checksum(file_name) * 31 + checksum(file_text);
+    auto [first, last] = source_index.equal_range(hash);
+    for (auto it = first; it != last; it++) {
+        const SourceFile* existing = source_files[it->second];
+        if (existing->name == file_name && existing->text == file_text) {
+            return it->second;
+        }
+    }
+    SourceFile* file = new SourceFile(file_name, file_text);
+    file->hash = hash;
+    int file_id;
+    if (free_source_ids.empty()) {
+        file_id = source_files.size();
+        source_files.push_back(file);
+    } else {
+        file_id = free_source_ids.back();
+        free_source_ids.pop_back();
+        source_files[file_id] = file;
+    }
+    source_index.emplace(file->hash, file_id);
+    return file_id;
+}
+
+const SourceFile& source_file(int file_id) {
+    return *source_files[file_id];
+}
+
+void retain_source_file(int file_id) {
+    source_files[file_id]->references++;
+}
+
+void release_source_file(int file_id) {
+    SourceFile* file = source_files[file_id];
+    if (--file->references > 0 || file_id == 0) {
+        return;
+    }
+    auto [first, last] = source_index.equal_range(file->hash);
+    for (auto it = first; it != last; it++) {
+        if (it->second == file_id) {
+            source_index.erase(it);
+            break;
+        }
+    }
+    delete file;
+    source_files[file_id] = nullptr;
+    free_source_ids.push_back(file_id);
+}
+
+// ************POSITION************
+
+Position::Position() : index(0), file_id(0) {}
+
+Position::Position(int index, int file_id) : index(index), file_id(file_id) {}
+
+void Position::advance(char current_char) {
+    index++;
 }
 
 Position Position::copy() {
-    return Position(index, line, col, file_name, file_text);
+    return Position(index, file_id);
+}
+
+int Position::line() const {
+    return source_file(file_id).line_at(index);
+}
+
+int Position::col() const {
+    return source_file(file_id).col_at(index);
+}
+
+const std::string& Position::file_name() const {
+    return source_file(file_id).name;
+}
+
+const std::string& Position::file_text() const {
+    return source_file(file_id).text;
 }
 
 // ************ERRORS************
@@ -381,27 +459,38 @@ Error::Error(Position pos_start, Position pos_end, std::string err_name, std::st
     this->pos_end = pos_end;
     this->err_name = err_name;
     this->details = details;
+    hold_source(pos_start.file_id);
+}
+
+Error::~Error() {
+    for (int file_id : sources) {
+        release_source_file(file_id);
+    }
+}
+
+// Keeps a file the error points into for as long as the error, since it may
+// be printed after the script it came from is freed
+void Error::hold_source(int file_id) {
+    if (file_id != 0 && std::find(sources.begin(), sources.end(), file_id) == sources.end()) {
+        retain_source_file(file_id);
+        sources.push_back(file_id);
+    }
+}
+
+void Error::set_start(Position pos_start) {
+    this->pos_start = pos_start;
+    hold_source(pos_start.file_id);
 }
 
 std::string Error::as_string() {
     std::string result = err_name + ": " + details;
     // add the file name and line number
-    result = result + "\nFile:" + "'" + pos_start.file_name + "'" + ", Line:" + std::to_string(pos_start.line + 1);
+    result = result + "\nFile:" + "'" + pos_start.file_name() + "'" + ", Line:" + std::to_string(pos_start.line() + 1);
 
-    // Extract just the error line from file_text
-    std::string error_line;
-    std::istringstream stream(pos_start.file_text);
-    std::string line;
-    int current_line = 0;
-    while (std::getline(stream, line)) {
-        if (current_line == pos_start.line) {
-            error_line = line;
-            break;
-        }
-        current_line++;
-    }
+    // Extract just the error line from the source file
+    std::string error_line = source_file(pos_start.file_id).line_text(pos_start.line());
 
-    result = result + "\n\n" + error_line + "\n" + std::string(pos_start.col, ' ') + "^";
+    result = result + "\n\n" + error_line + "\n" + std::string(pos_start.col(), ' ') + "^";
     return result;
 }
 
@@ -414,277 +503,1092 @@ InvalidSyntaxError::InvalidSyntaxError(Position pos_start, Position pos_end, std
 ExpectedCharError::ExpectedCharError(Position pos_start, Position pos_end, std::string details) 
     : Error(pos_start, pos_end, "Expected Character", details) {}
 
-RuntimeError::RuntimeError(Position pos_start, Position pos_end, std::string details, Context context) 
+RuntimeError::RuntimeError(Position pos_start, Position pos_end, std::string details, Context* context) 
     : Error(pos_start, pos_end, "Runtime Error", details) {
-    this->context = context;
-    this->context.parent_entry_pos = pos_start;
-    this->pos_start = pos_start;
+    for (Context* ctx = context; ctx != nullptr; ctx = ctx->parent) {
+        traceback.push_back(TracebackEntry{std::string(ctx->display_name), ctx->parent_entry_pos});
+        hold_source(ctx->parent_entry_pos.file_id);
+    }
+    if (!traceback.empty()) {
+        traceback[0].entry_pos = pos_start;
+    }
+}
+
+// Places an error that was raised without knowing where, e.g. by an operator
+void RuntimeError::set_pos(Position pos_start, Position pos_end) {
+    set_start(pos_start);
     this->pos_end = pos_end;
-    this->context.parent_entry_pos.file_name = pos_start.file_name;
-    this->context.parent_entry_pos.file_text = pos_start.file_text;     
+    if (!traceback.empty()) {
+        traceback[0].entry_pos = pos_start;
+    }
 }
 
 std::string RuntimeError::as_string() {
     std::string result = generate_traceback();
     result = result + err_name + ": " + details;
 
-    // Extract just the error line from file_text
-    std::string error_line;
-    std::istringstream stream(pos_start.file_text);
-    std::string line;
-    int current_line = 0;
-    while (std::getline(stream, line)) {
-        if (current_line == pos_start.line) {
-            error_line = line;
-            break;
-        }
-        current_line++;
-    }
+    // Extract just the error line from the source file
+    std::string error_line = source_file(pos_start.file_id).line_text(pos_start.line());
 
     // add arrows to point to the error
-    result = result + "\n\n" + error_line + "\n" + std::string(pos_start.col, ' ') + "^";
+    result = result + "\n\n" + error_line + "\n" + std::string(pos_start.col(), ' ') + "^";
     return result;
 }
 
 std::string RuntimeError::generate_traceback() {
     std::string result = "";
     Position pos = pos_start;
-    Context* ctx = &context;
-    while (ctx != nullptr) {
-        result = result + "  File " + "'" + pos.file_name + "'" + ", line " + std::to_string(pos.line + 1) + ", in " + ctx->display_name + "\n";
-        pos = ctx->parent_entry_pos;
-        ctx = ctx->parent;
+    for (TracebackEntry& entry : traceback) {
+        result = result + "  File " + "'" + pos.file_name() + "'" + ", line " + std::to_string(pos.line() + 1) + ", in " + entry.display_name + "\n";
+        pos = entry.entry_pos;
     }
     return "Traceback (most recent call last):\n" + result;
 }
 
 // ************RUN************
 
+Interner interner = Interner();
 SymbolTable global_symbol_table = SymbolTable();
+Context* current_context = nullptr;
+bool use_ast_interpreter = false;
+bool report_optimizations = false;
+
+// Built-ins bound by initialize_global_symbol_table(). Arguments are counted
+// before the function runs, so it can read args[0] to args[arity - 1].
+// input, input_int and clear ignore whatever they are given, as they always have
+const BuiltinDefinition BUILTIN_FUNCTIONS[] = {
+    {"print", BuiltinFunction::func_print, VARIADIC},
+    {"input", BuiltinFunction::func_input, VARIADIC},
+    {"input_int", BuiltinFunction::func_input_int, VARIADIC},
+    {"clear", BuiltinFunction::func_clear, VARIADIC},
+    {"is_number", BuiltinFunction::func_is_number, 1},
+    {"is_string", BuiltinFunction::func_is_string, 1},
+    {"is_list", BuiltinFunction::func_is_list, 1},
+    {"is_function", BuiltinFunction::func_is_function, 1},
+    {"append", BuiltinFunction::func_append, 2},
+    {"pop", BuiltinFunction::func_pop, 2},
+    {"extend", BuiltinFunction::func_extend, 2},
+    {"len", BuiltinFunction::func_len, 1},
+    {"run", BuiltinFunction::func_run, 1},
+    {"gc_stats", BuiltinFunction::func_gc_stats, 0},
+    {"flush", BuiltinFunction::func_flush, 0},
+};
+
+const std::vector<std::string_view>& builtin_names() {
+    static const std::vector<std::string_view> names = [] {
+        std::vector<std::string_view> names;
+        for (const BuiltinDefinition& builtin : BUILTIN_FUNCTIONS) {
+            names.push_back(builtin.name);
+        }
+        return names;
+    }();
+    return names;
+}
+
+void register_builtin(std::string_view name, NativeFunction function, int arity) {
+    int symbol = global_symbol_table.symbol(name);
+    global_symbol_table.bind(symbol, new BuiltinFunction(interner.name(symbol), function, arity));
+}
 
 void initialize_global_symbol_table() {
     global_symbol_table.set("null", null_);
     global_symbol_table.set("true", true_);
     global_symbol_table.set("false", false_);
-    global_symbol_table.set("print", new BuiltinFunction(Token(KEYWORD_TOKEN, "print")));
-    global_symbol_table.set("input", new BuiltinFunction(Token(KEYWORD_TOKEN, "input")));
-    global_symbol_table.set("input_int", new BuiltinFunction(Token(KEYWORD_TOKEN, "input_int")));
-    global_symbol_table.set("clear", new BuiltinFunction(Token(KEYWORD_TOKEN, "clear")));
-    global_symbol_table.set("is_number", new BuiltinFunction(Token(KEYWORD_TOKEN, "is_number")));
-    global_symbol_table.set("is_string", new BuiltinFunction(Token(KEYWORD_TOKEN, "is_string")));
-    global_symbol_table.set("is_list", new BuiltinFunction(Token(KEYWORD_TOKEN, "is_list")));
-    global_symbol_table.set("is_function", new BuiltinFunction(Token(KEYWORD_TOKEN, "is_function")));
-    global_symbol_table.set("append", new BuiltinFunction(Token(KEYWORD_TOKEN, "append")));
-    global_symbol_table.set("pop", new BuiltinFunction(Token(KEYWORD_TOKEN, "pop")));
-    global_symbol_table.set("extend", new BuiltinFunction(Token(KEYWORD_TOKEN, "extend")));
-    global_symbol_table.set("len", new BuiltinFunction(Token(KEYWORD_TOKEN, "len")));
-    global_symbol_table.set("run", new BuiltinFunction(Token(KEYWORD_TOKEN, "run")));
+    for (const BuiltinDefinition& builtin : BUILTIN_FUNCTIONS) {
+        register_builtin(builtin.name, builtin.function, builtin.arity);
+    }
     global_symbol_table.set("pi", pi_);
 }
 
-std::pair<Value*, Error*> run(std::string file_name, std::string text) {
+// Lexes, parses and resolves a script
+std::pair<Script, Error*> parse_script(std::string file_name, std::string text) {
+    int file_id = register_source_file(file_name, text);
+    Script script = Script{file_id, new Arena(file_id), nullptr};
+
     // Tokenization : Generate Tokens
-    Lexer lexer = Lexer(file_name, text);
+    Lexer lexer = Lexer(script.file_id);
     std::pair<std::vector<Token>, Error*> result = lexer.make_tokens();
 
-    if (result.second->err_name != "EOF") {
-        return std::pair<Value*, Error*>(nullptr, result.second);
+    if (result.second != nullptr) {
+        script.arena->release();
+        return std::pair<Script, Error*>(Script(), result.second);
     }
 
     // Parsing : Generate Abstract Syntax Tree
+    Arena* caller_arena = current_arena;
+    current_arena = script.arena;
     Parser parser = Parser(result.first);
     ParseResult* ast = parser.parse();
+    current_arena = caller_arena;
 
-    if (ast->error->err_name != "") {
-        return std::pair<Value*, Error*>(nullptr, ast->error);
+    if (ast->error != nullptr) {
+        Error* error = ast->error;
+        script.arena->release();
+        return std::pair<Script, Error*>(Script(), error);
     }
+    script.ast = ast->ast;
 
-    // Interpretation : Evaluate the AST
-    Interpreter interpreter = Interpreter(ast);
-    Context context = Context("<program>");
-    context.parent_entry_pos = Position(0, 0, 0, file_name, text);
-    context.symbol_table = global_symbol_table;
-    RuntimeResult output = interpreter.visit(ast->ast, context);
-    global_symbol_table = context.symbol_table;
+    // Resolution : Decide where each variable lives
+    Resolver resolver = Resolver();
+    resolver.resolve(script.ast);
 
-    return std::pair<Value*, Error*>(output.value, output.error);
+    return std::pair<Script, Error*>(script, nullptr);
 }
 
-// ************NODES************
+// Runs a parsed script at the top level
+std::pair<Value, Error*> execute(Script& script) {
+    // Values left over from earlier runs are only reachable through the global
+    // symbol table, so this is a safe point unless run() was called by a script
+    if (current_context == nullptr && heap.should_collect()) {
+        heap.collect();
+    }
 
-VarAccessNode::VarAccessNode() : var_name_token(Token()) {}
+    Arena* arena = script.arena;
+    arena->retain(); // in case the script replaces itself in the cache
+    Context context = Context("<program>");
+    context.parent_entry_pos = Position(0, script.file_id);
+    Context* caller_context = current_context;
+    current_context = &context;
+    if (!script.optimized) {
+        // Optimization : Fold constants and prune branches, after the image (if any) was written
+        // from the tree as parsed. Failing operators build their errors against current_context
+        Arena* caller_arena = current_arena;
+        current_arena = arena;
+        Optimizer optimizer = Optimizer();
+        script.ast = optimizer.optimize(script.ast);
+        current_arena = caller_arena;
+        script.optimized = true;
+    }
+    RuntimeResult output;
+    if (use_ast_interpreter) {
+        // Interpretation : Evaluate the AST
+        Interpreter interpreter = Interpreter(nullptr);
+        output = interpreter.visit(script.ast, context);
+    } else {
+        // Compilation : Lower the AST to bytecode
+        if (arena->chunk == nullptr) {
+            Compiler compiler = Compiler();
+            std::pair<Chunk*, Error*> compiled = compiler.compile(script.ast);
+            if (compiled.second != nullptr) {
+                delete compiled.first;
+                current_context = caller_context;
+                arena->release();
+                return std::pair<Value, Error*>(Value(), compiled.second);
+            }
+            arena->chunk = compiled.first;
+        }
 
-VarAccessNode::VarAccessNode(Token var_name_token) {
-    this->var_name_token = var_name_token;
-    this->pos_start = var_name_token.pos_start;
-    this->pos_end = var_name_token.pos_end;
-}
+        // Execution : Run the bytecode
+        VM vm = VM();
+        output = vm.run(arena->chunk, context);
+    }
+    current_context = caller_context;
+    arena->release();
 
-std::string VarAccessNode::repr() const {
-    return var_name_token.repr();
+    return std::pair<Value, Error*>(output.value, output.error);
 }
 
-VarAssignNode::VarAssignNode() : var_name_token(Token()), value_node(nullptr) {}
+// Runs a script file for vero script.vero [args], with the arguments in the
+// global args, and returns the process's exit status
+int run_file(const std::string& path, const std::vector<std::string>& args) {
+    std::vector<Value> arg_values;
+    for (const std::string& arg : args) {
+        arg_values.push_back(Value(new String(arg)));
+    }
+    global_symbol_table.set("args", Value(new List(arg_values)));
 
-VarAssignNode::VarAssignNode(Token var_name_token, Node* value_node) {
-    this->var_name_token = var_name_token;
-    this->value_node = value_node;
-    this->pos_start = var_name_token.pos_start;
-    this->pos_end = value_node->pos_end;
+    std::pair<Script*, Error*> script = script_cache.load(path);
+    Error* error = script.second;
+    if (script.first == nullptr && error == nullptr) {
+        std::cerr << "File: '" << path << "' not found" << std::endl;
+        return 1;
+    }
+    if (error == nullptr) {
+        error = execute(*script.first).second;
+    }
+    output_buffer.flush();
+    if (error != nullptr) {
+        std::cerr << error->as_string() << std::endl;
+        return 1;
+    }
+    return 0;
 }
 
-VarAssignNode::~VarAssignNode() {
-    delete value_node;
+std::pair<Value, Error*> run(std::string file_name, std::string text) {
+    std::pair<Script, Error*> parsed = parse_script(file_name, text);
+    if (parsed.second != nullptr) {
+        return std::pair<Value, Error*>(Value(), parsed.second);
+    }
+    std::pair<Value, Error*> result = execute(parsed.first);
+    parsed.first.arena->release();
+    return result;
 }
 
-std::string VarAssignNode::repr() const {
-    return "(" + var_name_token.repr() + ", " + value_node->repr() + ")";
-} 
-
-StringNode::StringNode() : token(Token()) {}
-
-StringNode::StringNode(Token token) {
-    this->token = token;
-    this->pos_start = token.pos_start;
-    this->pos_end = token.pos_end;
-}
+// ************SCRIPT CACHE************
 
-std::string StringNode::repr() const {
-    return token.repr();
-}
+ScriptCache script_cache = ScriptCache();
 
-NumberNode::NumberNode() : token(Token()) {}
+// Returns the script at path, loading it only if the file changed since it
+// was last loaded. The path may be a source file or an image, and a source
+// file's image (path + "c") is used instead of parsing it while it matches.
+// The script is nullptr without an error if there's no such file.
+std::pair<Script*, Error*> ScriptCache::load(const std::string& path) {
+    std::error_code error_code;
+    std::filesystem::file_time_type mtime = std::filesystem::last_write_time(path, error_code);
+    if (error_code) {
+        return std::pair<Script*, Error*>(nullptr, nullptr);
+    }
+    uintmax_t size = std::filesystem::file_size(path, error_code);
+    if (error_code) {
+        return std::pair<Script*, Error*>(nullptr, nullptr);
+    }
+    std::map<std::string, Entry>::iterator it = entries.find(path);
+    if (it != entries.end() && it->second.mtime == mtime && it->second.size == size) {
+        return std::pair<Script*, Error*>(&it->second.script, nullptr);
+    }
 
-NumberNode::NumberNode(Token token) {
-    this->token = token;
-    this->pos_start = token.pos_start;
-    this->pos_end = token.pos_end;
-}
+    MappedFile file = MappedFile();
+    if (!file.open(path)) {
+        return std::pair<Script*, Error*>(nullptr, nullptr);
+    }
+    std::pair<Script, Error*> loaded;
+    if (is_image(file.view())) {
+        loaded = load_image(path, file.view());
+    } else {
+        std::string_view text = file.view();
+        MappedFile image = MappedFile();
+        bool cached = image.open(path + "c");
+        if (cached) {
+            loaded = load_image(path + "c", image.view(), path, text);
+            cached = loaded.second == nullptr;
+        }
+        if (!cached) {
+            // failing to save the image is harmless, the script is just parsed again next time
+            loaded = parse_script(path, std::string(text));
+            if (loaded.second == nullptr) {
+                write_image(path + "c", loaded.first);
+            }
+        }
+    }
+    if (loaded.second != nullptr) {
+        return std::pair<Script*, Error*>(nullptr, loaded.second);
+    }
 
-std::string NumberNode::repr() const {
-    return token.repr();
+    if (it != entries.end()) {
+        // the old tree and its chunk are freed once no Function made from them is left
+        it->second.script.arena->release();
+        it->second = Entry{mtime, size, loaded.first};
+    } else {
+        it = entries.emplace(path, Entry{mtime, size, loaded.first}).first;
+    }
+    return std::pair<Script*, Error*>(&it->second.script, nullptr);
 }
 
-std::ostream& operator<<(std::ostream& os, const NumberNode& obj) {
-    os << obj.repr();
-    return os;
+// Parses the source file at path and saves its image next to it, for vero --compile
+Error* precompile(const std::string& path) {
+    MappedFile file = MappedFile();
+    if (!file.open(path)) {
+        return new ImageError("File: '" + path + "' not found");
+    }
+    if (is_image(file.view())) {
+        return new ImageError("'" + path + "' is already an image");
+    }
+    std::pair<Script, Error*> parsed = parse_script(path, std::string(file.view()));
+    if (parsed.second != nullptr) {
+        return parsed.second;
+    }
+    bool written = write_image(path + "c", parsed.first);
+    parsed.first.arena->release();
+    if (!written) {
+        return new ImageError("Could not write '" + path + "c'");
+    }
+    return nullptr;
 }
 
-BinOpNode::BinOpNode() : left(nullptr), op(Token()), right(nullptr) {}
-
-BinOpNode::BinOpNode(Node* left, Token op, Node* right) {
-    this->left = left;
-    this->op = op;
-    this->right = right;
-    this->pos_start = left->pos_start;
-    this->pos_end = right->pos_end;
-}
+// ************IMAGES************
 
-BinOpNode::~BinOpNode() {
-    delete left;
-    delete right;
-}
+ImageError::ImageError(std::string details) : Error(Position(), Position(), "Image Error", details) {}
 
-std::string BinOpNode::repr() const {
-    return "(" + left->repr() + ", " + op.repr() + ", " + right->repr() + ")";
+// Image errors are about files rather than a place in a script
+std::string ImageError::as_string() {
+    return err_name + ": " + details;
 }
 
-std::ostream& operator<<(std::ostream& os, const BinOpNode& obj) {
-    os << obj.repr();
-    return os;
+// Checks that an image is intact, reading 8 bytes at a time so that
+// verifying a large image doesn't cost a noticeable part of loading it
+uint64_t checksum(std::string_view data) {
+    uint64_t hash = 14695981039346656037ull ^ data.size();
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= data.size(); i += sizeof(uint64_t)) {
+        uint64_t word = 0;
+        std::memcpy(&word, data.data() + i, sizeof(word));
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+        hash ^= hash >> 29;
+    }
+    for (; i < data.size(); i++) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+    }
+    return hash;
 }
 
-UnaryOpNode::UnaryOpNode() : op(Token()), node(nullptr) {}
-
-UnaryOpNode::UnaryOpNode(Token op, Node* node) {
-    this->op = op;
-    this->node = node;
-    this->pos_start = op.pos_start;
-    this->pos_end = node->pos_end;
+bool is_image(std::string_view contents) {
+    return contents.size() >= sizeof(IMAGE_MAGIC) && std::memcmp(contents.data(), IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) == 0;
 }
 
-UnaryOpNode::~UnaryOpNode() {
-    delete node;
+void ImageWriter::write_u8(uint8_t value) {
+    out.push_back(static_cast<char>(value));
 }
 
-std::string UnaryOpNode::repr() const {
-    return "(" + op.repr() + ", " + node->repr() + ")";
+// LEB128, most numbers in a tree are small
+void ImageWriter::write_varint(uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
 }
 
-std::ostream& operator<<(std::ostream& os, const UnaryOpNode& obj) {
-    os << obj.repr();
-    return os;
+void ImageWriter::write_u64(uint64_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
 }
 
-IfNode::IfNode() : cases(std::vector<std::tuple<Node*, Node*, bool>>{std::make_tuple(nullptr, nullptr, false)}) {}
-
-IfNode::IfNode(std::vector<std::tuple<Node*, Node*, bool>> cases) {
-    this->cases = cases;
-    this->pos_start = std::get<0>(cases[0])->pos_start;
-    this->pos_end = std::get<0>(cases[cases.size() - 1])->pos_end;
+// Index first, shifted past -1 (the lexer's starting position), then whether
+// the position is in the script or is one of the default ones
+void ImageWriter::write_position(const Position& position) {
+    write_varint((static_cast<uint32_t>(position.index + 1) << 1) | (position.file_id != 0));
 }
 
-IfNode::~IfNode() {
-    for (int i = 0; i < cases.size(); i++) {
-        delete std::get<0>(cases[i]);
-        delete std::get<1>(cases[i]);
+// Nearly every token's value is the source between its positions, so only
+// the tokens the parser makes up, like a for's default step, store more
+void ImageWriter::write_token(const Token& token) {
+    write_u8(token.type);
+    write_position(token.pos_start);
+    write_position(token.pos_end);
+    if (token.value.data() >= text.data() && token.value.data() + token.value.size() <= text.data() + text.size()) {
+        uint32_t offset = token.value.data() - text.data();
+        if (static_cast<int>(offset) == token.pos_start.index && static_cast<int>(offset + token.value.size()) == token.pos_end.index) {
+            write_u8(SOURCE_TOKEN_VALUE);
+        } else {
+            write_u8(RANGE_TOKEN_VALUE);
+            write_varint(offset);
+            write_varint(token.value.size());
+        }
+    } else {
+        write_u8(INLINE_TOKEN_VALUE);
+        write_varint(token.value.size());
+        out.append(token.value);
     }
 }
 
-std::string IfNode::repr() const {
-    std::string result = "";
-    for (int i = 0; i < cases.size(); i++) {
-        result = result + "if " + std::get<0>(cases[i])->repr() + " then " + std::get<1>(cases[i])->repr() + "\n";
+// Pre-order, each node as its kind, its positions and then what its
+// constructor takes. A null child is written as NULL_NODE_TAG.
+void ImageWriter::write_node(Node* node) {
+    if (node == nullptr) {
+        write_u8(NULL_NODE_TAG);
+        return;
+    }
+    write_u8(node->kind);
+    write_position(node->pos_start);
+    write_position(node->pos_end);
+    switch (node->kind) {
+        case NUMBER_NODE:
+            write_token(static_cast<NumberNode*>(node)->token);
+            break;
+        case STRING_NODE:
+            write_token(static_cast<StringNode*>(node)->token);
+            break;
+        case VAR_ACCESS_NODE:
+            write_token(static_cast<VarAccessNode*>(node)->var_name_token);
+            break;
+        case VAR_ASSIGN_NODE: {
+            VarAssignNode* assign = static_cast<VarAssignNode*>(node);
+            write_token(assign->var_name_token);
+            write_node(assign->value_node);
+            break;
+        }
+        case BIN_OP_NODE: {
+            BinOpNode* bin_op = static_cast<BinOpNode*>(node);
+            write_node(bin_op->left);
+            write_token(bin_op->op);
+            write_node(bin_op->right);
+            break;
+        }
+        case UNARY_OP_NODE: {
+            UnaryOpNode* unary_op = static_cast<UnaryOpNode*>(node);
+            write_token(unary_op->op);
+            write_node(unary_op->node);
+            break;
+        }
+        case IF_NODE: {
+            IfNode* if_node = static_cast<IfNode*>(node);
+            write_varint(if_node->cases.size());
+            for (std::tuple<Node*, Node*, bool>& case_ : if_node->cases) {
+                write_node(std::get<0>(case_));
+                write_node(std::get<1>(case_));
+                write_u8(std::get<2>(case_));
+            }
+            break;
+        }
+        case FOR_NODE: {
+            ForNode* for_node = static_cast<ForNode*>(node);
+            write_token(for_node->var_name_token);
+            write_node(for_node->start_value_node);
+            write_node(for_node->end_value_node);
+            write_node(for_node->step_value_node);
+            write_node(for_node->body_node);
+            write_u8(for_node->should_return_null);
+            break;
+        }
+        case WHILE_NODE: {
+            WhileNode* while_node = static_cast<WhileNode*>(node);
+            write_node(while_node->condition_node);
+            write_node(while_node->body_node);
+            write_u8(while_node->should_return_null);
+            break;
+        }
+        case FUNC_DEF_NODE: {
+            FuncDefNode* func_def = static_cast<FuncDefNode*>(node);
+            write_token(func_def->var_name_token);
+            write_varint(func_def->arg_name_tokens.size());
+            for (const Token& arg_name_token : func_def->arg_name_tokens) {
+                write_token(arg_name_token);
+            }
+            write_node(func_def->body_node);
+            write_u8(func_def->should_auto_return);
+            break;
+        }
+        case CALL_NODE: {
+            CallNode* call = static_cast<CallNode*>(node);
+            write_node(call->node_to_call);
+            write_varint(call->args.size());
+            for (Node* arg : call->args) {
+                write_node(arg);
+            }
+            break;
+        }
+        case LIST_NODE: {
+            ListNode* list = static_cast<ListNode*>(node);
+            write_varint(list->elements.size());
+            for (Node* element : list->elements) {
+                write_node(element);
+            }
+            write_u8(list->should_return_null);
+            break;
+        }
+        case RETURN_NODE:
+            write_node(static_cast<ReturnNode*>(node)->node_to_return);
+            break;
+        case CONTINUE_NODE:
+            write_position(static_cast<ContinueNode*>(node)->pos_start);
+            write_position(static_cast<ContinueNode*>(node)->pos_end);
+            break;
+        case BREAK_NODE:
+            write_position(static_cast<BreakNode*>(node)->pos_start);
+            write_position(static_cast<BreakNode*>(node)->pos_end);
+            break;
     }
-    return result;
-}
-
-ForNode::ForNode() : var_name_token(Token()), start_value_node(nullptr), end_value_node(nullptr), step_value_node(nullptr), body_node(nullptr), should_return_null(false) {}
-
-ForNode::ForNode(Token var_name_token, Node* start_value_node, Node* end_value_node, Node* step_value_node, Node* body_node, bool should_return_null) {
-    this->var_name_token = var_name_token;
-    this->start_value_node = start_value_node;
-    this->end_value_node = end_value_node;
-    this->step_value_node = step_value_node;
-    this->body_node = body_node;
-    this->pos_start = var_name_token.pos_start;
-    this->pos_end = body_node->pos_end;
-    this->should_return_null = should_return_null;
-}
-
-ForNode::~ForNode() {
-    delete start_value_node;
-    delete end_value_node;
-    delete step_value_node;
-    delete body_node;
-}
-
-std::string ForNode::repr() const {
-    return "for " + var_name_token.repr() + " = " + start_value_node->repr() + " to " + end_value_node->repr() + " step " + step_value_node->repr() + " " + body_node->repr();
 }
 
-WhileNode::WhileNode() : condition_node(nullptr), body_node(nullptr), should_return_null(false) {}
-
-WhileNode::WhileNode(Node* condition_node, Node* body_node, bool should_return_null) {
-    this->condition_node = condition_node;
-    this->body_node = body_node;
-    this->pos_start = condition_node->pos_start;
-    this->pos_end = body_node->pos_end;
-    this->should_return_null = should_return_null;
+// An image is IMAGE_MAGIC, the format version, the script's name and text,
+// its tree and a checksum of everything after the magic. The text doubles as
+// the string table: identifiers, numbers and strings are ranges of it.
+bool write_image(const std::string& path, const Script& script) {
+    const SourceFile& source = source_file(script.file_id);
+    ImageWriter writer = ImageWriter();
+    writer.text = source.text;
+    writer.out.append(IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+    writer.write_varint(IMAGE_FORMAT_VERSION);
+    writer.write_varint(source.name.size());
+    writer.out.append(source.name);
+    writer.write_varint(source.text.size());
+    writer.out.append(source.text);
+    writer.write_node(script.ast);
+    writer.write_u64(checksum(std::string_view(writer.out).substr(sizeof(IMAGE_MAGIC))));
+    std::ofstream file(path, std::ios::binary);
+    file.write(writer.out.data(), writer.out.size());
+    return file.good();
+}
+
+uint8_t ImageReader::read_u8() {
+    if (end - data < 1) {
+        failed = true;
+        return 0;
+    }
+    return static_cast<uint8_t>(*data++);
+}
+
+uint32_t ImageReader::read_varint() {
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        uint8_t byte = read_u8();
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+    failed = true;
+    return 0;
+}
+
+Position ImageReader::read_position() {
+    uint32_t value = read_varint();
+    if ((value >> 1) > text.size() + 2) { // the lexer ends one past the end of the text
+        failed = true;
+        return Position();
+    }
+    return Position(static_cast<int>(value >> 1) - 1, (value & 1) ? file_id : 0);
+}
+
+Token ImageReader::read_token() {
+    Token token = Token();
+    uint8_t type = read_u8();
+    token.type = type <= NEWLINE_TOKEN ? static_cast<TokenType>(type) : NO_TOKEN;
+    failed |= type > NEWLINE_TOKEN;
+    token.pos_start = read_position();
+    token.pos_end = read_position();
+    uint32_t offset = token.pos_start.index;
+    uint32_t size = token.pos_end.index - token.pos_start.index;
+    switch (read_u8()) {
+        case SOURCE_TOKEN_VALUE:
+            if (token.pos_start.index < 0 || token.pos_end.index < token.pos_start.index) {
+                failed = true;
+                return token;
+            }
+            break;
+        case RANGE_TOKEN_VALUE:
+            offset = read_varint();
+            size = read_varint();
+            break;
+        case INLINE_TOKEN_VALUE: {
+            size = read_varint();
+            if (failed || static_cast<size_t>(end - data) < size) {
+                failed = true;
+                return token;
+            }
+            // made-up values are copied into the arena, which outlives the tree
+            char* value = static_cast<char*>(current_arena->allocate(size));
+            std::memcpy(value, data, size);
+            data += size;
+            token.value = std::string_view(value, size);
+            return token;
+        }
+        default:
+            failed = true;
+            return token;
+    }
+    if (offset > text.size() || size > text.size() - offset) {
+        failed = true;
+        return token;
+    }
+    token.value = text.substr(offset, size);
+    return token;
 }
 
-WhileNode::~WhileNode() {
-    delete condition_node;
-    delete body_node;
+// Rebuilds a node written by ImageWriter::write_node. On damaged input it sets
+// failed and returns an empty list, so that the constructors still get nodes.
+Node* ImageReader::read_node() {
+    uint8_t kind = read_u8();
+    if (kind == NULL_NODE_TAG && !failed) {
+        return nullptr;
+    }
+    if (failed || kind > BREAK_NODE) {
+        failed = true;
+        return new ListNode(std::vector<Node*>(), Position(), Position());
+    }
+    Position pos_start = read_position();
+    Position pos_end = read_position();
+    Node* node = nullptr;
+    switch (static_cast<NodeKind>(kind)) {
+        case NUMBER_NODE: {
+            // NumberNode reads its value as soon as it is made and trusts the lexer to have
+            // made the token, so check it like the lexer would have
+            Token token = read_token();
+            size_t dots = std::count(token.value.begin(), token.value.end(), '.');
+            bool digits = std::all_of(token.value.begin(), token.value.end(), [](char c) { return is_digit(c) || c == '.'; });
+            if (!digits || dots == token.value.size() || token.type != (dots == 0 ? INT_TOKEN : FLOAT_TOKEN) || dots > 1) {
+                failed = true;
+                return new ListNode(std::vector<Node*>(), Position(), Position());
+            }
+            node = new NumberNode(token);
+            break;
+        }
+        case STRING_NODE:
+            node = new StringNode(read_token());
+            break;
+        case VAR_ACCESS_NODE:
+            node = new VarAccessNode(read_token());
+            break;
+        case VAR_ASSIGN_NODE: {
+            Token var_name_token = read_token();
+            node = new VarAssignNode(var_name_token, read_child());
+            break;
+        }
+        case BIN_OP_NODE: {
+            Node* left = read_child();
+            Token op = read_token();
+            node = new BinOpNode(left, op, read_child());
+            break;
+        }
+        case UNARY_OP_NODE: {
+            Token op = read_token();
+            node = new UnaryOpNode(op, read_child());
+            break;
+        }
+        case IF_NODE: {
+            std::vector<std::tuple<Node*, Node*, bool>> cases;
+            uint32_t count = read_varint();
+            for (uint32_t i = 0; i < count && !failed; i++) {
+                Node* condition = read_child();
+                Node* expr = read_child();
+                cases.push_back(std::make_tuple(condition, expr, read_u8() != 0));
+            }
+            if (cases.empty()) {
+                failed = true;
+                return new ListNode(std::vector<Node*>(), Position(), Position());
+            }
+            node = new IfNode(cases);
+            break;
+        }
+        case FOR_NODE: {
+            Token var_name_token = read_token();
+            Node* start_value_node = read_child();
+            Node* end_value_node = read_child();
+            Node* step_value_node = read_child();
+            Node* body_node = read_child();
+            node = new ForNode(var_name_token, start_value_node, end_value_node, step_value_node, body_node, read_u8() != 0);
+            break;
+        }
+        case WHILE_NODE: {
+            Node* condition_node = read_child();
+            Node* body_node = read_child();
+            node = new WhileNode(condition_node, body_node, read_u8() != 0);
+            break;
+        }
+        case FUNC_DEF_NODE: {
+            Token var_name_token = read_token();
+            std::vector<Token> arg_name_tokens;
+            uint32_t count = read_varint();
+            for (uint32_t i = 0; i < count && !failed; i++) {
+                arg_name_tokens.push_back(read_token());
+            }
+            Node* body_node = read_child();
+            node = new FuncDefNode(var_name_token, arg_name_tokens, body_node, read_u8() != 0);
+            break;
+        }
+        case CALL_NODE: {
+            Node* node_to_call = read_child();
+            std::vector<Node*> args;
+            uint32_t count = read_varint();
+            for (uint32_t i = 0; i < count && !failed; i++) {
+                args.push_back(read_child());
+            }
+            node = new CallNode(node_to_call, args);
+            break;
+        }
+        case LIST_NODE: {
+            std::vector<Node*> elements;
+            uint32_t count = read_varint();
+            for (uint32_t i = 0; i < count && !failed; i++) {
+                elements.push_back(read_child());
+            }
+            ListNode* list = new ListNode(elements, pos_start, pos_end);
+            list->should_return_null = read_u8() != 0;
+            node = list;
+            break;
+        }
+        case RETURN_NODE:
+            node = new ReturnNode(read_node(), pos_start, pos_end);
+            break;
+        case CONTINUE_NODE: {
+            Position continue_start = read_position();
+            node = new ContinueNode(continue_start, read_position());
+            break;
+        }
+        case BREAK_NODE: {
+            Position break_start = read_position();
+            node = new BreakNode(break_start, read_position());
+            break;
+        }
+    }
+    node->pos_start = pos_start;
+    node->pos_end = pos_end;
+    return node;
+}
+
+// A child that has to be there
+Node* ImageReader::read_child() {
+    Node* node = read_node();
+    if (node == nullptr) {
+        failed = true;
+        return new ListNode(std::vector<Node*>(), Position(), Position());
+    }
+    return node;
+}
+
+// Rebuilds the script in an image. Given the source file an image was saved
+// next to, the image is only used if it was made from that text, and the
+// script is named after the file rather than what it was called when saved.
+std::pair<Script, Error*> load_image(const std::string& path, std::string_view image, const std::string& source_path, std::string_view source) {
+    std::string damaged = "'" + path + "' is damaged or was made by another version of Vero";
+    if (!is_image(image) || image.size() < sizeof(IMAGE_MAGIC) + sizeof(uint64_t)) {
+        return std::pair<Script, Error*>(Script(), new ImageError(damaged));
+    }
+    std::string_view contents = image.substr(sizeof(IMAGE_MAGIC), image.size() - sizeof(IMAGE_MAGIC) - sizeof(uint64_t));
+    uint64_t stored_checksum = 0;
+    std::memcpy(&stored_checksum, image.data() + image.size() - sizeof(uint64_t), sizeof(stored_checksum));
+    if (stored_checksum != checksum(contents)) {
+        return std::pair<Script, Error*>(Script(), new ImageError(damaged));
+    }
+
+    ImageReader reader = ImageReader();
+    reader.data = contents.data();
+    reader.end = contents.data() + contents.size();
+    if (reader.read_varint() != IMAGE_FORMAT_VERSION) {
+        return std::pair<Script, Error*>(Script(), new ImageError(damaged));
+    }
+    std::string_view strings[2]; // the name and the text
+    for (std::string_view& string : strings) {
+        uint32_t size = reader.read_varint();
+        if (reader.failed || static_cast<size_t>(reader.end - reader.data) < size) {
+            return std::pair<Script, Error*>(Script(), new ImageError(damaged));
+        }
+        string = std::string_view(reader.data, size);
+        reader.data += size;
+    }
+    if (!source_path.empty() && source != strings[1]) {
+        return std::pair<Script, Error*>(Script(), new ImageError("'" + path + "' is out of date"));
+    }
+
+    // The registry keeps its own copy of the text, which is the only one made:
+    // token values are pointed straight at it as the nodes are rebuilt
+    std::string name = source_path.empty() ? std::string(strings[0]) : source_path;
+    int file_id = register_source_file(name, std::string(strings[1]));
+    Script script = Script{file_id, new Arena(file_id), nullptr};
+    reader.file_id = script.file_id;
+    reader.text = source_file(script.file_id).text;
+    Arena* caller_arena = current_arena;
+    current_arena = script.arena;
+    script.ast = reader.read_child();
+    current_arena = caller_arena;
+    if (reader.failed || reader.data != reader.end) {
+        script.arena->release();
+        return std::pair<Script, Error*>(Script(), new ImageError(damaged));
+    }
+
+    // Resolution : Decide where each variable lives
+    Resolver resolver = Resolver();
+    resolver.resolve(script.ast);
+
+    return std::pair<Script, Error*>(script, nullptr);
+}
+
+// ************MAPPED FILES************
+
+MappedFile::~MappedFile() {
+#ifdef VERO_HAS_MMAP
+    if (mapping != nullptr) {
+        munmap(mapping, size);
+    }
+#endif
+}
+
+// Maps the whole file where the platform supports it, otherwise reads it
+bool MappedFile::open(const std::string& path) {
+#ifdef VERO_HAS_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        return false;
+    }
+    size = info.st_size;
+    if (size > 0) {
+        mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            mapping = nullptr;
+            close(fd);
+            return false;
+        }
+        data = static_cast<const char*>(mapping);
+    }
+    close(fd);
+    return true;
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    buffer = contents.str();
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+#endif
+}
+
+std::string_view MappedFile::view() const {
+    return size == 0 ? std::string_view() : std::string_view(data, size);
+}
+
+// ************ARENA************
+
+Arena* current_arena = nullptr;
+size_t Arena::live_bytes = 0;
+size_t Arena::high_water = 0;
+
+Arena::Arena(int file_id) : file_id(file_id) {
+    retain_source_file(file_id);
+}
+
+Arena::~Arena() {
+    delete chunk;
+    for (std::vector<Node*>::reverse_iterator it = nodes.rbegin(); it != nodes.rend(); it++) {
+        (*it)->~Node();
+    }
+    for (char* block : blocks) {
+        ::operator delete(block);
+    }
+    live_bytes -= bytes;
+    // last, as the tokens point into the text
+    release_source_file(file_id);
+}
+
+void* Arena::allocate(size_t size) {
+    size = (size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+    char* memory;
+    if (size > BLOCK_SIZE / 4) {
+        // big allocations get their own block, in front so the last one keeps filling
+        memory = static_cast<char*>(::operator new(size));
+        blocks.insert(blocks.begin(), memory);
+    } else {
+        if (size > BLOCK_SIZE - block_used) {
+            blocks.push_back(static_cast<char*>(::operator new(BLOCK_SIZE)));
+            block_used = 0;
+        }
+        memory = blocks.back() + block_used;
+        block_used += size;
+    }
+    bytes += size;
+    live_bytes += size;
+    high_water = std::max(high_water, live_bytes);
+    return memory;
+}
+
+void Arena::retain() {
+    references++;
+}
+
+void Arena::release() {
+    if (--references == 0) {
+        delete this;
+    }
+}
+
+// ************NODES************
+
+Node::Node(NodeKind kind) : kind(kind) {}
+
+void* Node::operator new(size_t size) {
+    if (current_arena == nullptr) {
+        return ::operator new(size);
+    }
+    void* node = current_arena->allocate(size);
+    current_arena->nodes.push_back(static_cast<Node*>(node));
+    return node;
+}
+
+VarAccessNode::VarAccessNode() : Node(VAR_ACCESS_NODE), var_name_token(Token()) {}
+
+VarAccessNode::VarAccessNode(Token var_name_token) : Node(VAR_ACCESS_NODE) {
+    this->var_name_token = var_name_token;
+    this->pos_start = var_name_token.pos_start;
+    this->pos_end = var_name_token.pos_end;
+}
+
+std::string VarAccessNode::repr() const {
+    return var_name_token.repr();
+}
+
+VarAssignNode::VarAssignNode() : Node(VAR_ASSIGN_NODE), var_name_token(Token()), value_node(nullptr) {}
+
+VarAssignNode::VarAssignNode(Token var_name_token, Node* value_node) : Node(VAR_ASSIGN_NODE) {
+    this->var_name_token = var_name_token;
+    this->value_node = value_node;
+    this->pos_start = var_name_token.pos_start;
+    this->pos_end = value_node->pos_end;
+}
+
+std::string VarAssignNode::repr() const {
+    return "(" + var_name_token.repr() + ", " + value_node->repr() + ")";
+} 
+
+StringNode::StringNode() : Node(STRING_NODE), token(Token()) {}
+
+StringNode::StringNode(Token token) : Node(STRING_NODE) {
+    this->token = token;
+    this->value = string_value(token.value);
+    this->pos_start = token.pos_start;
+    this->pos_end = token.pos_end;
+}
+
+std::string StringNode::repr() const {
+    return token.repr();
+}
+
+NumberNode::NumberNode() : Node(NUMBER_NODE), token(Token()) {}
+
+NumberNode::NumberNode(Token token) : Node(NUMBER_NODE) {
+    this->token = token;
+    this->pos_start = token.pos_start;
+    this->pos_end = token.pos_end;
+    // check which type of number
+    if (token.type == INT_TOKEN) {
+        value = Value(static_cast<int64_t>(std::stoll(std::string(token.value))));
+    } else if (token.type == FLOAT_TOKEN) {
+        value = Value(std::stod(std::string(token.value)));
+    }
+}
+
+// A literal the Optimizer worked out, which has no text of its own
+NumberNode::NumberNode(Value value, Position pos_start, Position pos_end) : Node(NUMBER_NODE) {
+    this->token = Token(value.type == Value::INTEGER ? INT_TOKEN : FLOAT_TOKEN);
+    this->value = value;
+    this->pos_start = pos_start;
+    this->pos_end = pos_end;
+}
+
+std::string NumberNode::repr() const {
+    if (token.value.empty()) {
+        return token.repr() + ":" + value.repr();
+    }
+    return token.repr();
+}
+
+std::ostream& operator<<(std::ostream& os, const NumberNode& obj) {
+    os << obj.repr();
+    return os;
+}
+
+BinOpNode::BinOpNode() : Node(BIN_OP_NODE), left(nullptr), op(Token()), right(nullptr), op_code(OP_ADD) {}
+
+BinOpNode::BinOpNode(Node* left, Token op, Node* right) : Node(BIN_OP_NODE) {
+    this->left = left;
+    this->op = op;
+    this->right = right;
+    this->pos_start = left->pos_start;
+    this->pos_end = right->pos_end;
+    // both engines dispatch on the opcode rather than on the token
+    if (op.type == PLUS_TOKEN) {
+        op_code = OP_ADD;
+    } else if (op.type == MINUS_TOKEN) {
+        op_code = OP_SUBTRACT;
+    } else if (op.type == MUL_TOKEN) {
+        op_code = OP_MULTIPLY;
+    } else if (op.type == DIV_TOKEN) {
+        op_code = OP_DIVIDE;
+    } else if (op.type == POWER_TOKEN) {
+        op_code = OP_POWER;
+    } else if (op.type == EE_TOKEN) {
+        op_code = OP_EQUAL;
+    } else if (op.type == NE_TOKEN) {
+        op_code = OP_NOT_EQUAL;
+    } else if (op.type == LT_TOKEN) {
+        op_code = OP_LESS;
+    } else if (op.type == GT_TOKEN) {
+        op_code = OP_GREATER;
+    } else if (op.type == LTE_TOKEN) {
+        op_code = OP_LESS_EQUAL;
+    } else if (op.type == GTE_TOKEN) {
+        op_code = OP_GREATER_EQUAL;
+    } else if (op.matches(KEYWORD_TOKEN, "and")) {
+        op_code = OP_AND;
+    } else {
+        op_code = OP_OR;
+    }
+}
+
+std::string BinOpNode::repr() const {
+    return "(" + left->repr() + ", " + op.repr() + ", " + right->repr() + ")";
+}
+
+std::ostream& operator<<(std::ostream& os, const BinOpNode& obj) {
+    os << obj.repr();
+    return os;
+}
+
+UnaryOpNode::UnaryOpNode() : Node(UNARY_OP_NODE), op(Token()), node(nullptr) {}
+
+UnaryOpNode::UnaryOpNode(Token op, Node* node) : Node(UNARY_OP_NODE) {
+    this->op = op;
+    this->node = node;
+    this->pos_start = op.pos_start;
+    this->pos_end = node->pos_end;
+}
+
+std::string UnaryOpNode::repr() const {
+    return "(" + op.repr() + ", " + node->repr() + ")";
+}
+
+std::ostream& operator<<(std::ostream& os, const UnaryOpNode& obj) {
+    os << obj.repr();
+    return os;
+}
+
+IfNode::IfNode() : Node(IF_NODE), cases(std::vector<std::tuple<Node*, Node*, bool>>{std::make_tuple(nullptr, nullptr, false)}) {}
+
+IfNode::IfNode(std::vector<std::tuple<Node*, Node*, bool>> cases) : Node(IF_NODE) {
+    this->cases = cases;
+    this->pos_start = std::get<0>(cases[0])->pos_start;
+    this->pos_end = std::get<0>(cases[cases.size() - 1])->pos_end;
+}
+
+std::string IfNode::repr() const {
+    std::string result = "";
+    for (int i = 0; i < cases.size(); i++) {
+        Node* condition = std::get<0>(cases[i]);
+        result = result + "if " + (condition != nullptr ? condition->repr() : "1") + " then " + std::get<1>(cases[i])->repr() + "\n";
+    }
+    return result;
+}
+
+ForNode::ForNode() : Node(FOR_NODE), var_name_token(Token()), start_value_node(nullptr), end_value_node(nullptr), step_value_node(nullptr), body_node(nullptr), should_return_null(false) {}
+
+ForNode::ForNode(Token var_name_token, Node* start_value_node, Node* end_value_node, Node* step_value_node, Node* body_node, bool should_return_null) : Node(FOR_NODE) {
+    this->var_name_token = var_name_token;
+    this->start_value_node = start_value_node;
+    this->end_value_node = end_value_node;
+    this->step_value_node = step_value_node;
+    this->body_node = body_node;
+    this->pos_start = var_name_token.pos_start;
+    this->pos_end = body_node->pos_end;
+    this->should_return_null = should_return_null;
+}
+
+std::string ForNode::repr() const {
+    return "for " + var_name_token.repr() + " = " + start_value_node->repr() + " to " + end_value_node->repr() + " step " + step_value_node->repr() + " " + body_node->repr();
+}
+
+WhileNode::WhileNode() : Node(WHILE_NODE), condition_node(nullptr), body_node(nullptr), should_return_null(false) {}
+
+WhileNode::WhileNode(Node* condition_node, Node* body_node, bool should_return_null) : Node(WHILE_NODE) {
+    this->condition_node = condition_node;
+    this->body_node = body_node;
+    this->pos_start = condition_node->pos_start;
+    this->pos_end = body_node->pos_end;
+    this->should_return_null = should_return_null;
 }
 
 std::string WhileNode::repr() const {
     return "while " + condition_node->repr() + " " + body_node->repr();
 }
 
-FuncDefNode::FuncDefNode() : var_name_token(Token()), arg_name_tokens(std::vector<Token>{Token()}), body_node(nullptr), should_auto_return(false) {}
+FuncDefNode::FuncDefNode() : Node(FUNC_DEF_NODE), var_name_token(Token()), arg_name_tokens(std::vector<Token>{Token()}), body_node(nullptr), should_auto_return(false) {}
 
-FuncDefNode::FuncDefNode(Token var_name_token, std::vector<Token> arg_name_tokens, Node* body_node, bool should_auto_return) {
+FuncDefNode::FuncDefNode(Token var_name_token, std::vector<Token> arg_name_tokens, Node* body_node, bool should_auto_return) : Node(FUNC_DEF_NODE) {
     this->var_name_token = var_name_token;
     this->arg_name_tokens = arg_name_tokens;
     this->body_node = body_node;
@@ -701,8 +1605,12 @@ FuncDefNode::FuncDefNode(Token var_name_token, std::vector<Token> arg_name_token
     this->pos_end = this->body_node->pos_end;
 }
 
+// Once its tree is freed no frame can hold its locals, so calls to globals of
+// their names can be cached again
 FuncDefNode::~FuncDefNode() {
-    delete body_node;
+    for (int symbol : shadowed) {
+        global_symbol_table.shadows[symbol]--;
+    }
 }
 
 std::string FuncDefNode::repr() const {
@@ -717,9 +1625,9 @@ std::string FuncDefNode::repr() const {
     return result;
 }
 
-CallNode::CallNode() : node_to_call(nullptr), args(std::vector<Node*>{new NumberNode(Token())}) {}
+CallNode::CallNode() : Node(CALL_NODE), node_to_call(nullptr), args(std::vector<Node*>{new NumberNode(Token())}) {}
 
-CallNode::CallNode(Node* node_to_call, std::vector<Node*> args) {
+CallNode::CallNode(Node* node_to_call, std::vector<Node*> args) : Node(CALL_NODE) {
     this->node_to_call = node_to_call;
     this->args = args;
     this->pos_start = node_to_call->pos_start;
@@ -730,13 +1638,6 @@ CallNode::CallNode(Node* node_to_call, std::vector<Node*> args) {
     }
 }
 
-CallNode::~CallNode() {
-    delete node_to_call;
-    for (int i = 0; i < args.size(); i++) {
-        delete args[i];
-    }
-}
-
 std::string CallNode::repr() const {
     std::string result = node_to_call->repr() + "(";
     for (int i = 0; i < args.size(); i++) {
@@ -749,18 +1650,12 @@ std::string CallNode::repr() const {
     return result;
 }
 
-ListNode::ListNode(std::vector<Node*> elements, Position pos_start, Position pos_end) {
+ListNode::ListNode(std::vector<Node*> elements, Position pos_start, Position pos_end) : Node(LIST_NODE) {
     this->elements = elements;
     this->pos_start = pos_start;
     this->pos_end = pos_end;
 }
 
-ListNode::~ListNode() {
-    for (int i = 0; i < elements.size(); i++) {
-        delete elements[i];
-    }
-}
-
 std::string ListNode::repr() const {
     std::string result = "[";
     for (int i = 0; i < elements.size(); i++) {
@@ -773,23 +1668,19 @@ std::string ListNode::repr() const {
     return result;
 }
 
-ReturnNode::ReturnNode() : node_to_return(nullptr) {}
+ReturnNode::ReturnNode() : Node(RETURN_NODE), node_to_return(nullptr) {}
 
-ReturnNode::ReturnNode(Node* node_to_return, Position pos_start, Position pos_end) {
+ReturnNode::ReturnNode(Node* node_to_return, Position pos_start, Position pos_end) : Node(RETURN_NODE) {
     this->node_to_return = node_to_return;
     this->pos_start = pos_start;
     this->pos_end = pos_end;
 }
 
-ReturnNode::~ReturnNode() {
-    delete node_to_return;
-}
-
 std::string ReturnNode::repr() const {
     return "return " + node_to_return->repr();
 }
 
-ContinueNode::ContinueNode(Position pos_start, Position pos_end) {
+ContinueNode::ContinueNode(Position pos_start, Position pos_end) : Node(CONTINUE_NODE) {
     this->pos_start = pos_start;
     this->pos_end = pos_end;
 }
@@ -798,7 +1689,7 @@ std::string ContinueNode::repr() const {
     return "continue";
 }
 
-BreakNode::BreakNode(Position pos_start, Position pos_end) {
+BreakNode::BreakNode(Position pos_start, Position pos_end) : Node(BREAK_NODE) {
     this->pos_start = pos_start;
     this->pos_end = pos_end;
 }
@@ -809,13 +1700,21 @@ std::string BreakNode::repr() const {
 
 // ************PARSE RESULT************
 
-ParseResult::ParseResult() : ast(nullptr), error(new Error(Position(-1, -1, -1, "", ""), Position(-1, -1, -1, "", ""), "", "")), advance_count(0), to_reverse_count(0) {}
+ParseResult::ParseResult() : ast(nullptr), error(nullptr), advance_count(0) {}
+
+ParseResult::ParseResult(Node* ast, Error* error) : ast(ast), error(error), advance_count(0) {}
 
-ParseResult::ParseResult(Node* ast, Error* error) : ast(ast), error(error), advance_count(0), to_reverse_count(0) {}
+void* ParseResult::operator new(size_t size) {
+    static_assert(std::is_trivially_destructible_v<ParseResult>, "the arena doesn't destroy parse results");
+    if (current_arena == nullptr) {
+        return ::operator new(size);
+    }
+    return current_arena->allocate(size);
+}
 
 Node* ParseResult::reg(ParseResult* result) {
     advance_count += result->advance_count;
-    if (result->error->err_name != "") {
+    if (result->error != nullptr) {
         this->error = result->error;
     }
     return result->ast;
@@ -841,23 +1740,418 @@ ParseResult* ParseResult::success(T* n) {
 }
 
 ParseResult* ParseResult::failure(Error* error) {
-    if (this->error->err_name == "" || advance_count == 0) {
+    if (this->error == nullptr || advance_count == 0) {
         this->error = error;
     }
     return this;
 }
 
-Node* ParseResult::try_register(ParseResult* res) {
-    if (res->error->err_name != "") {
-        this->to_reverse_count = res->advance_count;
-        return nullptr;
+// ************RESOLVER************
+
+std::vector<Node*> child_nodes(Node* node) {
+    std::vector<Node*> children;
+    switch (node->kind) {
+        case VAR_ASSIGN_NODE:
+            children.push_back(static_cast<VarAssignNode*>(node)->value_node);
+            break;
+        case BIN_OP_NODE:
+            children.push_back(static_cast<BinOpNode*>(node)->left);
+            children.push_back(static_cast<BinOpNode*>(node)->right);
+            break;
+        case UNARY_OP_NODE:
+            children.push_back(static_cast<UnaryOpNode*>(node)->node);
+            break;
+        case IF_NODE:
+            for (std::tuple<Node*, Node*, bool>& case_ : static_cast<IfNode*>(node)->cases) {
+                children.push_back(std::get<0>(case_));
+                children.push_back(std::get<1>(case_));
+            }
+            break;
+        case FOR_NODE: {
+            ForNode* for_node = static_cast<ForNode*>(node);
+            children.push_back(for_node->start_value_node);
+            children.push_back(for_node->end_value_node);
+            children.push_back(for_node->step_value_node);
+            children.push_back(for_node->body_node);
+            break;
+        }
+        case WHILE_NODE:
+            children.push_back(static_cast<WhileNode*>(node)->condition_node);
+            children.push_back(static_cast<WhileNode*>(node)->body_node);
+            break;
+        case FUNC_DEF_NODE:
+            children.push_back(static_cast<FuncDefNode*>(node)->body_node);
+            break;
+        case CALL_NODE:
+            children.push_back(static_cast<CallNode*>(node)->node_to_call);
+            for (Node* arg : static_cast<CallNode*>(node)->args) {
+                children.push_back(arg);
+            }
+            break;
+        case LIST_NODE:
+            children = static_cast<ListNode*>(node)->elements;
+            break;
+        case RETURN_NODE:
+            children.push_back(static_cast<ReturnNode*>(node)->node_to_return);
+            break;
+        default:
+            break;
+    }
+    // optional parts, such as a for loop's step, are left as nullptr
+    children.erase(std::remove(children.begin(), children.end(), nullptr), children.end());
+    return children;
+}
+
+void Resolver::resolve(Node* node) {
+    switch (node->kind) {
+        case VAR_ACCESS_NODE: {
+            VarAccessNode* access = static_cast<VarAccessNode*>(node);
+            resolve_name(access->var_name_token.value, access->symbol, access->slot);
+            break;
+        }
+        case VAR_ASSIGN_NODE: {
+            VarAssignNode* assign = static_cast<VarAssignNode*>(node);
+            resolve_name(assign->var_name_token.value, assign->symbol, assign->slot);
+            break;
+        }
+        case FOR_NODE: {
+            ForNode* for_node = static_cast<ForNode*>(node);
+            resolve_name(for_node->var_name_token.value, for_node->symbol, for_node->slot);
+            if (for_node->should_return_null) {
+                discard_value(for_node->body_node);
+            }
+            break;
+        }
+        case WHILE_NODE: {
+            WhileNode* while_node = static_cast<WhileNode*>(node);
+            if (while_node->should_return_null) {
+                discard_value(while_node->body_node);
+            }
+            break;
+        }
+        case FUNC_DEF_NODE: {
+            FuncDefNode* func_def = static_cast<FuncDefNode*>(node);
+            if (!func_def->var_name_token.value.empty()) {
+                resolve_name(func_def->var_name_token.value, func_def->symbol, func_def->slot);
+            }
+            if (!func_def->should_auto_return) {
+                discard_value(func_def->body_node);
+            }
+            resolve_function(func_def);
+            return;
+        }
+        case RETURN_NODE: {
+            // whether the call is to the running function is only known when it is made
+            Node* node_to_return = static_cast<ReturnNode*>(node)->node_to_return;
+            if (!scopes.empty() && node_to_return != nullptr && node_to_return->kind == CALL_NODE) {
+                static_cast<CallNode*>(node_to_return)->tail_call = true;
+            }
+            break;
+        }
+        case CALL_NODE: {
+            // the callee's frame is named after the name it is called by
+            CallNode* call = static_cast<CallNode*>(node);
+            if (call->node_to_call->kind == VAR_ACCESS_NODE) {
+                std::string_view callee = static_cast<VarAccessNode*>(call->node_to_call)->var_name_token.value;
+                call->display_name = interner.name(interner.intern("<" + std::string(callee) + ">"));
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    for (Node* child : child_nodes(node)) {
+        resolve(child);
+    }
+}
+
+void Resolver::resolve_name(std::string_view name, int& symbol, int& slot) {
+    symbol = global_symbol_table.symbol(name);
+    slot = -1;
+    if (!scopes.empty()) {
+        std::map<int, int>::iterator it = scopes.back().slots.find(symbol);
+        if (it != scopes.back().slots.end()) {
+            slot = it->second;
+        }
+    }
+}
+
+void Resolver::resolve_function(FuncDefNode* node) {
+    scopes.push_back(Scope{node, std::map<int, int>()});
+    Scope& scope = scopes.back();
+    for (Token& arg_name_token : node->arg_name_tokens) {
+        // every argument gets a slot, even if a later one has the same name
+        int symbol = global_symbol_table.symbol(arg_name_token.value);
+        scope.slots[symbol] = node->locals.size();
+        node->locals.push_back(symbol);
+    }
+    declare_locals(scope, node->body_node);
+    for (const std::pair<const int, int>& local : scope.slots) {
+        node->shadowed.push_back(local.first);
+        global_symbol_table.shadows[local.first]++;
+        global_symbol_table.versions[local.first]++; // a call may now find a caller's local instead
+    }
+    resolve(node->body_node);
+    scopes.pop_back();
+}
+
+void Resolver::declare(Scope& scope, int symbol) {
+    if (scope.slots.find(symbol) == scope.slots.end()) {
+        scope.slots[symbol] = scope.function->locals.size();
+        scope.function->locals.push_back(symbol);
+    }
+}
+
+// Marks the loops and statement blocks whose value is thrown away, so they
+// don't build result lists that nobody reads
+void Resolver::discard_value(Node* node) {
+    switch (node->kind) {
+        case LIST_NODE: {
+            ListNode* list = static_cast<ListNode*>(node);
+            list->should_return_null = true;
+            for (Node* element : list->elements) {
+                discard_value(element);
+            }
+            break;
+        }
+        case FOR_NODE:
+            static_cast<ForNode*>(node)->should_return_null = true;
+            break;
+        case WHILE_NODE:
+            static_cast<WhileNode*>(node)->should_return_null = true;
+            break;
+        default:
+            break;
+    }
+}
+
+// Gives a slot to every name the function assigns, wherever the assignment is,
+// so that accesses before it in a loop body still find the local
+void Resolver::declare_locals(Scope& scope, Node* node) {
+    if (node->kind == VAR_ASSIGN_NODE) {
+        declare(scope, global_symbol_table.symbol(static_cast<VarAssignNode*>(node)->var_name_token.value));
+    } else if (node->kind == FOR_NODE) {
+        declare(scope, global_symbol_table.symbol(static_cast<ForNode*>(node)->var_name_token.value));
+    } else if (node->kind == FUNC_DEF_NODE) {
+        std::string_view name = static_cast<FuncDefNode*>(node)->var_name_token.value;
+        if (!name.empty()) {
+            declare(scope, global_symbol_table.symbol(name));
+        }
+        return; // the body of a nested function has locals of its own
+    }
+    for (Node* child : child_nodes(node)) {
+        declare_locals(scope, child);
+    }
+}
+
+// ************OPTIMIZER************
+
+// Optimizes the tree under node and returns what should take its place, which
+// is node itself unless it could be folded or pruned away
+Node* Optimizer::optimize(Node* node) {
+    switch (node->kind) {
+        case VAR_ASSIGN_NODE: {
+            VarAssignNode* assign = static_cast<VarAssignNode*>(node);
+            assign->value_node = optimize(assign->value_node);
+            break;
+        }
+        case BIN_OP_NODE: {
+            BinOpNode* bin_op = static_cast<BinOpNode*>(node);
+            bin_op->left = optimize(bin_op->left);
+            bin_op->right = optimize(bin_op->right);
+            return fold_bin_op(bin_op);
+        }
+        case UNARY_OP_NODE: {
+            UnaryOpNode* unary_op = static_cast<UnaryOpNode*>(node);
+            unary_op->node = optimize(unary_op->node);
+            return fold_unary_op(unary_op);
+        }
+        case IF_NODE: {
+            for (std::tuple<Node*, Node*, bool>& case_ : static_cast<IfNode*>(node)->cases) {
+                std::get<0>(case_) = optimize(std::get<0>(case_));
+                std::get<1>(case_) = optimize(std::get<1>(case_));
+            }
+            return prune_if(static_cast<IfNode*>(node));
+        }
+        case FOR_NODE: {
+            ForNode* for_node = static_cast<ForNode*>(node);
+            for_node->start_value_node = optimize(for_node->start_value_node);
+            for_node->end_value_node = optimize(for_node->end_value_node);
+            if (for_node->step_value_node != nullptr) {
+                for_node->step_value_node = optimize(for_node->step_value_node);
+            }
+            for_node->body_node = optimize(for_node->body_node);
+            break;
+        }
+        case WHILE_NODE: {
+            WhileNode* while_node = static_cast<WhileNode*>(node);
+            while_node->condition_node = optimize(while_node->condition_node);
+            while_node->body_node = optimize(while_node->body_node);
+            break;
+        }
+        case FUNC_DEF_NODE: {
+            FuncDefNode* func_def = static_cast<FuncDefNode*>(node);
+            func_def->body_node = optimize(func_def->body_node);
+            break;
+        }
+        case CALL_NODE: {
+            CallNode* call = static_cast<CallNode*>(node);
+            call->node_to_call = optimize(call->node_to_call);
+            for (Node*& arg : call->args) {
+                arg = optimize(arg);
+            }
+            break;
+        }
+        case LIST_NODE:
+            for (Node*& element : static_cast<ListNode*>(node)->elements) {
+                element = optimize(element);
+            }
+            break;
+        case RETURN_NODE: {
+            ReturnNode* return_node = static_cast<ReturnNode*>(node);
+            if (return_node->node_to_return != nullptr) {
+                return_node->node_to_return = optimize(return_node->node_to_return);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return node;
+}
+
+bool integer_overflow(OpCode op, int64_t left, int64_t right) {
+    const int64_t max = std::numeric_limits<int64_t>::max();
+    const int64_t min = std::numeric_limits<int64_t>::min();
+    switch (op) {
+        case OP_ADD:
+            return right > 0 ? left > max - right : left < min - right;
+        case OP_SUBTRACT:
+            return right < 0 ? left > max + right : left < min + right;
+        case OP_MULTIPLY:
+            if (left > 0) {
+                return right > 0 ? left > max / right : right < min / left;
+            }
+            return right > 0 ? left < min / right : left != 0 && right < max / left;
+        case OP_DIVIDE:
+            return left == min && right == -1;
+        default:
+            return false;
+    }
+}
+
+// Operators are applied with the engines' own code, so a folded result is
+// exactly what running the operator would give. One that fails, such as a
+// division by zero, or that overflows is left to run.
+Node* Optimizer::fold_bin_op(BinOpNode* node) {
+    if (node->left->kind != NUMBER_NODE || node->right->kind != NUMBER_NODE) {
+        return node;
+    }
+    Value left = static_cast<NumberNode*>(node->left)->value;
+    Value right = static_cast<NumberNode*>(node->right)->value;
+    if (left.type == Value::INTEGER && right.type == Value::INTEGER && integer_overflow(node->op_code, left.int_value, right.int_value)) {
+        return node;
+    }
+    std::pair<Value, Error*> result = VM::binary_operation(node->op_code, left, right);
+    if (result.second != nullptr) {
+        return node;
+    }
+    report(node->pos_start, "folded " + source_text(node) + " to " + result.first.repr());
+    return make_literal(result.first, node);
+}
+
+Node* Optimizer::fold_unary_op(UnaryOpNode* node) {
+    if (node->node->kind != NUMBER_NODE) {
+        return node;
+    }
+    Value operand = static_cast<NumberNode*>(node->node)->value;
+    // a minus multiplies its operand by -1
+    if (node->op.type == MINUS_TOKEN && operand.type == Value::INTEGER && integer_overflow(OP_MULTIPLY, operand.int_value, -1)) {
+        return node;
+    }
+    std::pair<Value, Error*> result = Interpreter(nullptr).unary_operation(node->op, operand);
+    if (result.second != nullptr) {
+        return node;
+    }
+    // a sign in front of a literal is just part of how it's written, so only not is reported
+    if (node->op.matches(KEYWORD_TOKEN, "not")) {
+        report(node->pos_start, "folded " + source_text(node) + " to " + result.first.repr());
+    }
+    return make_literal(result.first, node);
+}
+
+// Drops the cases whose condition is a false literal, and everything after a
+// case whose condition is a true literal, which also loses its condition.
+// An else is a case whose condition is the literal 1.
+Node* Optimizer::prune_if(IfNode* node) {
+    std::vector<std::tuple<Node*, Node*, bool>> cases;
+    std::vector<bool> returns_null;
+    for (size_t i = 0; i < node->cases.size(); i++) {
+        Node* condition = std::get<0>(node->cases[i]);
+        Node* body = std::get<1>(node->cases[i]);
+        if (condition->kind == NUMBER_NODE) {
+            if (!static_cast<NumberNode*>(condition)->value.is_true()) {
+                report(body->pos_start, "removed a branch that is never taken");
+                continue;
+            }
+            // an else's condition isn't in the source
+            if (condition->pos_start.file_id != 0) {
+                report(condition->pos_start, "removed the test of a condition that is always true");
+            }
+            for (size_t j = i + 1; j < node->cases.size(); j++) {
+                report(std::get<1>(node->cases[j])->pos_start, "removed a branch that is never reached");
+            }
+            condition = nullptr;
+        }
+        cases.push_back(std::make_tuple(condition, body, false));
+        returns_null.push_back(i == std::get<2>(node->cases[i]));
+        if (condition == nullptr) {
+            break;
+        }
+    }
+
+    if (cases.empty()) {
+        return make_literal(Value(static_cast<int64_t>(0)), node);
+    }
+    if (cases.size() == 1 && std::get<0>(cases[0]) == nullptr && !returns_null[0]) {
+        return std::get<1>(cases[0]);
+    }
+    // Both engines take a case to give null when its index equals its
+    // multi-line flag (false is 0, true is 1). A case that moved gets the flag
+    // that keeps that answer at its new index. Only cases 0 and 1 can give
+    // null, and cases only ever move to a lower index, so such a flag exists
+    auto flag_for_index = [](size_t index, bool returns_null) {
+        return returns_null ? index == 1 : index != 1;
+    };
+    for (size_t i = 0; i < cases.size(); i++) {
+        std::get<2>(cases[i]) = flag_for_index(i, returns_null[i]);
+    }
+    node->cases = cases;
+    return node;
+}
+
+// A literal standing in for node
+NumberNode* Optimizer::make_literal(Value value, Node* node) {
+    return new NumberNode(value, node->pos_start, node->pos_end);
+}
+
+std::string Optimizer::source_text(Node* node) {
+    const std::string& text = node->pos_start.file_text();
+    if (node->pos_end.file_id != node->pos_start.file_id || static_cast<size_t>(node->pos_end.index) > text.length() || node->pos_end.index <= node->pos_start.index) {
+        return node->repr();
+    }
+    return text.substr(node->pos_start.index, node->pos_end.index - node->pos_start.index);
+}
+
+void Optimizer::report(const Position& pos, const std::string& change) {
+    if (report_optimizations) {
+        std::cerr << "File '" << pos.file_name() << "', line " << pos.line() + 1 << ": " << change << std::endl;
     }
-    return reg(res);
 }
 
 // ************PARSER************
 
-Parser::Parser(std::vector<Token> tokens) : tokens(tokens), token_index(-1) {
+Parser::Parser(const std::vector<Token>& tokens) : tokens(tokens), token_index(-1) {
     advance();
 }
 
@@ -869,18 +2163,46 @@ Token Parser::advance() {
     return current_token;
 }
 
-Token Parser::reverse(int amount) {
-    token_index-=amount;
-    if (token_index>=0 && token_index < tokens.size()) {
-        current_token = tokens[token_index];
-    }
+// Goes back to an earlier token, only used to give up on a statement that failed to parse
+Token Parser::rewind(int token_index) {
+    this->token_index = token_index;
+    current_token = tokens[token_index];
     return current_token;
 }
 
+bool Parser::at_builtin_call() const {
+    const std::vector<std::string_view>& names = builtin_names();
+    return current_token.type == KEYWORD_TOKEN && std::find(names.begin(), names.end(), current_token.value) != names.end();
+}
+
+// Whether the current token can begin an expression, so that optional
+// expressions and further statements are only parsed when one is there
+bool Parser::at_expression_start() const {
+    switch (current_token.type) {
+        case INT_TOKEN:
+        case FLOAT_TOKEN:
+        case STRING_TOKEN:
+        case IDENTIFIER_TOKEN:
+        case PLUS_TOKEN:
+        case MINUS_TOKEN:
+        case LPAREN_TOKEN:
+        case LSQUARE_TOKEN:
+            return true;
+        case KEYWORD_TOKEN:
+            return current_token.value == "let" || current_token.value == "not" || current_token.value == "if" || current_token.value == "for" || current_token.value == "while" || current_token.value == "func" || at_builtin_call();
+        default:
+            return false;
+    }
+}
+
+bool Parser::at_statement_start() const {
+    return current_token.matches(KEYWORD_TOKEN, "return") || current_token.matches(KEYWORD_TOKEN, "continue") || current_token.matches(KEYWORD_TOKEN, "break") || at_expression_start();
+}
+
 ParseResult* Parser::call() {
     ParseResult* res = new ParseResult();
     Node* atom_res = res->reg(atom());
-    if (res->error->err_name != "") {
+    if (res->error != nullptr) {
         return res;
     }
 
@@ -893,14 +2215,14 @@ ParseResult* Parser::call() {
             advance();
         } else {
             args.push_back(res->reg(expr()));
-            if (res->error->err_name != "") {
+            if (res->error != nullptr) {
                 return res->failure(new InvalidSyntaxError(current_token.pos_start, current_token.pos_end, "Expected ')', 'var', 'if', 'for', 'while', 'func', INT, FLOAT, IDENTIFIER, '+', '-' '[' or '('"));
             }
             while (current_token.type == COMMA_TOKEN) {
                 res->reg_advancement();
                 advance();
                 args.push_back(res->reg(expr()));
-                if (res->error->err_name != "") {
+                if (res->error != nullptr) {
                     return res;
                 }
             }
@@ -934,52 +2256,47 @@ ParseResult* Parser::atom() {
         res->reg_advancement();
         advance();
         ParseResult* expr_res = expr();
-        if (expr_res->error->err_name != "") {
-            delete res;
+        if (expr_res->error != nullptr) {
             return expr_res;
         }
         if (current_token.type == RPAREN_TOKEN) {
             res->reg_advancement();
             advance();
-            Node* expr_node = expr_res->ast;
-            expr_res->ast = nullptr; // to prevent double deletion
-            delete expr_res;
-            return res->success(expr_node);
+            return res->success(expr_res->ast);
         } else {
-            delete expr_res;
             return res->failure(new InvalidSyntaxError(token.pos_start, token.pos_end, "Expected ')'"));
         }
     } else if (token.matches(KEYWORD_TOKEN, "if")) {
         Node* if_expression = res->reg(if_expr());
-        if (res->error->err_name != "") {
+        if (res->error != nullptr) {
             return res;
         }
         return res->success(if_expression);
     } else if (token.matches(KEYWORD_TOKEN, "for")) {
         Node* for_expression = res->reg(for_expr());
-        if (res->error->err_name != "") {
+        if (res->error != nullptr) {
             return res;
         }
         return res->success(for_expression);
     } else if (token.matches(KEYWORD_TOKEN, "while")) {
         Node* while_expression = res->reg(while_expr());
-        if (res->error->err_name != "") {
+        if (res->error != nullptr) {
             return res;
         }
         return res->success(while_expression);
     } else if (token.matches(KEYWORD_TOKEN, "func")) {
         Node* func_definition = res->reg(func_def());
-        if (res->error->err_name != "") {
+        if (res->error != nullptr) {
             return res;
         }
         return res->success(func_definition);
     } else if (token.type == LSQUARE_TOKEN) {
         Node* list_expr_res = res->reg(list_expr());
-        if (res->error->err_name != "") {
+        if (res->error != nullptr) {
             return res;
         }
         return res->success(list_expr_res);
-    } else if (token.matches(KEYWORD_TOKEN, "print") || token.matches(KEYWORD_TOKEN, "input") || token.matches(KEYWORD_TOKEN, "input_int") || token.matches(KEYWORD_TOKEN, "clear") || token.matches(KEYWORD_TOKEN, "is_number") || token.matches(KEYWORD_TOKEN, "is_string") || token.matches(KEYWORD_TOKEN, "is_list") || token.matches(KEYWORD_TOKEN, "is_function") || token.matches(KEYWORD_TOKEN, "append") || token.matches(KEYWORD_TOKEN, "pop") || token.matches(KEYWORD_TOKEN, "extend") || token.matches(KEYWORD_TOKEN, "len") || token.matches(KEYWORD_TOKEN, "run")) {
+    } else if (at_builtin_call()) {
         res->reg_advancement();
         advance();
         if (current_token.type == LPAREN_TOKEN) {
@@ -988,14 +2305,14 @@ ParseResult* Parser::atom() {
             std::vector<Node*> args;
             if (current_token.type != RPAREN_TOKEN) {
                 args.push_back(res->reg(expr()));
-                if (res->error->err_name != "") {
+                if (res->error != nullptr) {
                     return res;
                 }
                 while (current_token.type == COMMA_TOKEN) {
                     res->reg_advancement();
                     advance();
                     args.push_back(res->reg(expr()));
-                    if (res->error->err_name != "") {
+                    if (res->error != nullptr) {
                         return res;
                     }
                 }
@@ -1013,19 +2330,19 @@ ParseResult* Parser::atom() {
     return res->failure(new InvalidSyntaxError(token.pos_start, token.pos_end, "Expected INT, FLOAT, IDENTIFIER, 'if', 'while', 'func', '+', '-', '(' or '['"));
 }
 
-std::pair<std::vector<std::tuple<Node*, Node*, bool>>, ParseResult*> Parser::if_expr_cases(std::string case_keyword) {
+std::pair<std::vector<std::tuple<Node*, Node*, bool>>, ParseResult*> Parser::if_expr_cases(std::string_view case_keyword) {
     ParseResult* res = new ParseResult();
     std::vector<std::tuple<Node*, Node*, bool>> cases = std::vector<std::tuple<Node*, Node*, bool>>{};
 
     if (!current_token.matches(KEYWORD_TOKEN, case_keyword)) {
-        return std::pair(cases, res->failure(new InvalidSyntaxError(current_token.pos_start, current_token.pos_end, "Expected '" + case_keyword + "'")));
+        return std::pair(cases, res->failure(new InvalidSyntaxError(current_token.pos_start, current_token.pos_end, "Expected '" + std::string(case_keyword) + "'")));
     }
 
     res->reg_advancement();
     advance();
 
     Node* condition = res->reg(this->expr());
-    if (res->error->err_name != "") {
+    if (res->error != nullptr) {
         return std::pair(cases, res);
     }
 
@@ -1041,7 +2358,7 @@ std::pair<std::vector<std::tuple<Node*, Node*, bool>>, ParseResult*> Parser::if_
         advance();
 
         Node* statements = res->reg(this->statements());
-        if (res->error->err_name != "") {
+        if (res->error != nullptr) {
             return std::pair(cases, res);
         }
         cases.push_back(std::make_tuple(condition, statements, true));
@@ -1057,7 +2374,7 @@ std::pair<std::vector<std::tuple<Node*, Node*, bool>>, ParseResult*> Parser::if_
             std::pair<std::vector<std::tuple<Node*, Node*, bool>>, ParseResult*> if_expr_boc;
             if_expr_boc = this->if_expr_b_or_c();
             res->reg(if_expr_boc.second);
-            if (res->error->err_name != "") {
+            if (res->error != nullptr) {
                 return std::pair(cases, res);
             }
             std::vector<std::tuple<Node*, Node*, bool>> all_cases = if_expr_boc.first;
@@ -1075,7 +2392,7 @@ std::pair<std::vector<std::tuple<Node*, Node*, bool>>, ParseResult*> Parser::if_
             }
 
             Node* statements = res->reg(this->statements());
-            if (res->error->err_name != "") {
+            if (res->error != nullptr) {
                 return std::pair(cases, res);
             }
             std::tuple<Node*, Node*, bool> new_case = std::make_tuple(new NumberNode(Token(INT_TOKEN, "1")), statements, true);
@@ -1090,7 +2407,7 @@ std::pair<std::vector<std::tuple<Node*, Node*, bool>>, ParseResult*> Parser::if_
         }
     } else {
         Node* expr = res->reg(this->statement());
-        if (res->error->err_name != "") {
+        if (res->error != nullptr) {
             return std::pair(cases, res);
         }
         cases.push_back(std::make_tuple(condition, expr, false));
@@ -1110,7 +2427,7 @@ std::pair<std::vector<std::tuple<Node*, Node*, bool>>, ParseResult*> Parser::if_
         // check if there are more cases
         if (if_expr_boc.first.size() > 0) {
             res->reg(if_expr_boc.second);
-            if (res->error->err_name != "") {
+            if (res->error != nullptr) {
                 return std::pair(cases, res);
             }
             all_cases = if_expr_boc.first;
@@ -1126,7 +2443,7 @@ ParseResult* Parser::if_expr() {
     std::pair<std::vector<std::tuple<Node*, Node*, bool>>, ParseResult*> if_exp;
     if_exp = if_expr_cases("if");
     res->reg(if_exp.second);
-    if (res->error->err_name != "") {
+    if (res->error != nullptr) {
         return res;
     }
     std::vector<std::tuple<Node*, Node*, bool>> cases = if_exp.first;
@@ -1146,7 +2463,7 @@ std::pair<std::vector<std::tuple<Node*, Node*, bool>>, ParseResult*> Parser::if_
         std::pair<std::vector<std::tuple<Node*, Node*, bool>>, ParseResult*> if_exprb;
         if_exprb = this->if_expr_b();
         res->reg(if_exprb.second);
-        if (res->error->err_name != "") {
+        if (res->error != nullptr) {
             return std::pair(cases, res);
         }
         std::vector<std::tuple<Node*, Node*, bool>> all_cases = if_exprb.first;
@@ -1164,7 +2481,7 @@ std::pair<std::vector<std::tuple<Node*, Node*, bool>>, ParseResult*> Parser::if_
         }
 
         Node* statements = res->reg(this->statements());
-        if (res->error->err_name != "") {
+        if (res->error != nullptr) {
             return std::pair(cases, res);
         }
         std::tuple<Node*, Node*, bool> new_case = std::make_tuple(new NumberNode(Token(INT_TOKEN, "1")), statements, true);
@@ -1207,7 +2524,7 @@ ParseResult* Parser::for_expr() {
     advance();
 
     Node* start_value = res->reg(expr());
-    if (res->error->err_name != "") {
+    if (res->error != nullptr) {
         return res;
     }
 
@@ -1219,7 +2536,7 @@ ParseResult* Parser::for_expr() {
     advance();
 
     Node* end_value = res->reg(expr());
-    if (res->error->err_name != "") {
+    if (res->error != nullptr) {
         return res;
     }
 
@@ -1228,7 +2545,7 @@ ParseResult* Parser::for_expr() {
         res->reg_advancement();
         advance();
         step_value = res->reg(expr());
-        if (res->error->err_name != "") {
+        if (res->error != nullptr) {
             return res;
         }
     } else {
@@ -1247,7 +2564,7 @@ ParseResult* Parser::for_expr() {
         advance();
 
         Node* body = res->reg(statements());
-        if (res->error->err_name != "") {
+        if (res->error != nullptr) {
             return res;
         }
 
@@ -1262,7 +2579,7 @@ ParseResult* Parser::for_expr() {
     }
 
     Node* body = res->reg(statement());
-    if (res->error->err_name != "") {
+    if (res->error != nullptr) {
         return res;
     }
 
@@ -1289,7 +2606,7 @@ ParseResult* Parser::while_expr() {
     ParseResult* condition_res = expr();
     Node* condition = res->reg(condition_res);
 
-    if (res->error->err_name != "") {
+    if (res->error != nullptr) {
         return res;
     }
 
@@ -1305,7 +2622,7 @@ ParseResult* Parser::while_expr() {
         advance();
 
         Node* body = res->reg(statements());
-        if (res->error->err_name != "") {
+        if (res->error != nullptr) {
             return res;
         }
 
@@ -1320,7 +2637,7 @@ ParseResult* Parser::while_expr() {
     }
 
     Node* body = res->reg(statement());
-    if (res->error->err_name != "") {
+    if (res->error != nullptr) {
         return res;
     }
 
@@ -1402,7 +2719,7 @@ ParseResult* Parser::func_def() {
             advance();
 
             Node* body = res->reg(statements());
-            if (res->error->err_name != "") {
+            if (res->error != nullptr) {
                 return res;
             }
 
@@ -1416,7 +2733,7 @@ ParseResult* Parser::func_def() {
             return res->success(new FuncDefNode(var_name, arg_name_tokens, body, true));
         } else {
             Node* body = res->reg(expr());
-            if (res->error->err_name != "") {
+            if (res->error != nullptr) {
                 return res;
             }
 
@@ -1434,33 +2751,6 @@ ParseResult* Parser::func_def() {
     return res->failure(new InvalidSyntaxError(current_token.pos_start, current_token.pos_end, "Expected '{'"));
 }
 
-ParseResult* Parser::factor() {
-    ParseResult* res = new ParseResult();
-    Token token = current_token;
-    if (token.type == PLUS_TOKEN || token.type == MINUS_TOKEN) {
-        res->reg_advancement();
-        advance();
-        ParseResult* factor_res = factor();
-        if (factor_res->error->err_name != "") {
-            delete res;
-            return factor_res;
-        }
-        Node* factor_node = factor_res->ast;
-        factor_res->ast = nullptr; // to prevent double deletion
-        delete factor_res;
-        return res->success(new UnaryOpNode(token, factor_node));
-    } 
-    return power();
-}
-
-ParseResult* Parser::power() {
-    return bin_op(&Parser::call, {POWER_TOKEN}, &Parser::factor);
-}
-
-ParseResult* Parser::term() {
-    return bin_op(&Parser::factor, {MUL_TOKEN, DIV_TOKEN});
-}
-
 ParseResult* Parser::statement() {
     ParseResult* res = new ParseResult();
     Position pos_start = current_token.pos_start.copy();
@@ -1469,9 +2759,15 @@ ParseResult* Parser::statement() {
         res->reg_advancement();
         advance();
 
-        Node* expr = res->try_register(this->expr());
-        if (expr == nullptr) {
-            reverse(res->to_reverse_count);
+        Node* expr = nullptr;
+        if (at_expression_start()) {
+            int expr_start = token_index;
+            ParseResult* expr_res = this->expr();
+            if (expr_res->error == nullptr) {
+                expr = res->reg(expr_res);
+            } else {
+                rewind(expr_start); // a bare return, the rest is reported by the caller
+            }
         }
         return res->success(new ReturnNode(expr, pos_start, current_token.pos_end.copy()));
     }
@@ -1489,7 +2785,7 @@ ParseResult* Parser::statement() {
     }
 
     Node* expr = res->reg(this->expr());
-    if (res->error->err_name != "") {
+    if (res->error != nullptr) {
         return res->failure(new InvalidSyntaxError(current_token.pos_start, current_token.pos_end, "Expected 'let', 'if', 'for', 'while', 'func', 'return', 'continue', 'break', INT, FLOAT, IDENTIFIER, '+', '-', '[', '(', 'not' or 'print'"));
     }
 
@@ -1507,12 +2803,11 @@ ParseResult* Parser::statements() {
     }
 
     Node* statement = res->reg(this->statement());
-    if (res->error->err_name != "") {
+    if (res->error != nullptr) {
         return res;
     }
     statements.push_back(statement);
 
-    bool more_statements = true;
     while (true) {
         int newlines = 0;
         while (current_token.type == NEWLINE_TOKEN) {
@@ -1520,19 +2815,28 @@ ParseResult* Parser::statements() {
             advance();
             newlines++;
         }
-        if (newlines == 0) {
-            more_statements = false;
-        }
-        if (!more_statements) {
+        if (newlines == 0 || !at_statement_start()) {
             break;
         }
-        statement = res->try_register(this->statement());
-        if (statement == nullptr) {
-            reverse(res->to_reverse_count);
-            more_statements = false;
-            continue;
+        int statement_start = token_index;
+        ParseResult* statement_res = this->statement();
+        if (statement_res->error != nullptr) {
+            // the block ends before a statement it can't parse, and the caller
+            // reports the first token after the newlines where it stopped. It
+            // backs up by the statement's advance count, which leaves out the
+            // inside of a signed operand or of a parenthesized expression, so
+            // the error can point past the statement's first token. When only
+            // the end of the input is left there, it goes back to the
+            // statement's first token instead, or the caller would find
+            // nothing to report.
+            int stop = token_index - statement_res->advance_count;
+            while (tokens[stop].type == NEWLINE_TOKEN) {
+                stop++;
+            }
+            rewind(tokens[stop].type == EOF_TOKEN ? statement_start : stop);
+            break;
         }
-        statements.push_back(statement);
+        statements.push_back(res->reg(statement_res));
     }
 
     return res->success(new ListNode(statements, pos_start, current_token.pos_end.copy()));
@@ -1556,13 +2860,13 @@ ParseResult* Parser::expr() {
         advance();
         ParseResult* expr_res = expr();
         Node* expr = res->reg(expr_res);
-        if (res->error->err_name != "") {
+        if (res->error != nullptr) {
             return res;
         }
         return res->success(new VarAssignNode(var_name, expr));
     } else {
-        Node* node = res->reg(bin_op(&Parser::comp_expr, {}, nullptr, {{KEYWORD_TOKEN, "and"}, {KEYWORD_TOKEN, "or"}}));
-        if (res->error->err_name != "") {
+        Node* node = res->reg(binary_expr(LOGICAL_PRECEDENCE));
+        if (res->error != nullptr) {
             return res->failure(new InvalidSyntaxError(current_token.pos_start, current_token.pos_end, "Expected 'let', INT, FLOAT, IDENTIFIER, 'if', 'while', 'func', '+', '-', '[' or '('"));
         }
         return res->success(node);
@@ -1571,75 +2875,90 @@ ParseResult* Parser::expr() {
 
 ParseResult* Parser::parse() {
     ParseResult* result = statements();
-    if (result->error->err_name == "" && current_token.type != EOF_TOKEN) {
+    if (result->error == nullptr && current_token.type != EOF_TOKEN) {
         return result->failure(new InvalidSyntaxError(current_token.pos_start, current_token.pos_end, "Expected '+', '-', '*', or '/'"));
     }
     return result;
 }
 
-ParseResult* Parser::bin_op(ParseResult* (Parser::*func1)(), std::vector<std::string> ops, ParseResult* (Parser::*func2)(), std::vector<std::vector<std::string>> ops_with_values) {
-    if (func2==nullptr) {
-        func2 = func1;
+// Binary operators, loosest first. Every level groups to the left except '^',
+// whose right operand is parsed at its own level and may have a sign.
+const BinaryOperator BINARY_OPERATORS[] = {
+    {KEYWORD_TOKEN, "and", LOGICAL_PRECEDENCE},
+    {KEYWORD_TOKEN, "or", LOGICAL_PRECEDENCE},
+    {EE_TOKEN, "", COMPARISON_PRECEDENCE},
+    {NE_TOKEN, "", COMPARISON_PRECEDENCE},
+    {LT_TOKEN, "", COMPARISON_PRECEDENCE},
+    {GT_TOKEN, "", COMPARISON_PRECEDENCE},
+    {LTE_TOKEN, "", COMPARISON_PRECEDENCE},
+    {GTE_TOKEN, "", COMPARISON_PRECEDENCE},
+    {PLUS_TOKEN, "", SUM_PRECEDENCE},
+    {MINUS_TOKEN, "", SUM_PRECEDENCE},
+    {MUL_TOKEN, "", PRODUCT_PRECEDENCE},
+    {DIV_TOKEN, "", PRODUCT_PRECEDENCE},
+    {POWER_TOKEN, "", POWER_PRECEDENCE},
+};
+
+// Precedence of the operator at the current token, 0 if it isn't one
+int Parser::binary_precedence() const {
+    for (const BinaryOperator& op : BINARY_OPERATORS) {
+        if (current_token.type == op.type && (op.keyword.empty() || current_token.value == op.keyword)) {
+            return op.precedence;
+        }
     }
+    return 0;
+}
 
+// Precedence climbing: parses operands joined by operators that bind at least
+// as tightly as min_precedence, in one pass over the tokens
+ParseResult* Parser::binary_expr(int min_precedence) {
     ParseResult* res = new ParseResult();
-    Node* left = res->reg((this->*func1)());
-    if (res->error->err_name != "") {
-        return res;
-    }
-
-    if (ops_with_values.empty()) { // if ops_with_values is empty, then value of operator does not matter
-        while (std::find(ops.begin(), ops.end(), current_token.type) != ops.end()) {
+    Node* left = res->reg(unary_expr(min_precedence));
+    if (res->error == nullptr) {
+        int precedence;
+        while ((precedence = binary_precedence()) >= min_precedence && precedence != 0) {
             Token op = current_token;
             res->reg_advancement();
             advance();
-            Node* right = res->reg((this->*func2)());
-            if (res->error->err_name != "") {
+            Node* right = res->reg(binary_expr(precedence == POWER_PRECEDENCE ? precedence : precedence + 1));
+            if (res->error != nullptr) {
                 return res;
             }
             left = new BinOpNode(left, op, right);
         }
-
-        return res->success(left);
-    } else { // if ops_with_values is not empty, then value of operator matters and is checked
-        while (std::find_if(ops_with_values.begin(), ops_with_values.end(), [&](const std::vector<std::string>& op) { return op[0] == current_token.type && op[1] == current_token.value; }) != ops_with_values.end()) {
-            Token op = current_token;
-            res->reg_advancement();
-            advance();
-            Node* right = res->reg((this->*func2)());
-            if (res->error->err_name != "") {
-                return res;
-            }
-            left = new BinOpNode(left, op, right);
-        }
-
         return res->success(left);
     }
+    if (min_precedence == COMPARISON_PRECEDENCE && res->advance_count == 0) {
+        return res->failure(new InvalidSyntaxError(current_token.pos_start, current_token.pos_end, "Expected 'not', INT, FLOAT, IDENTIFIER, '+', '-', '[' or '('"));
+    }
+    return res;
 }
 
-ParseResult* Parser::comp_expr() {
-    ParseResult* res = new ParseResult();
-
-    if (current_token.matches(KEYWORD_TOKEN, "not")) {
-        Token op = current_token;
+// A call with any prefix operators. 'not' applies to a whole comparison, so it
+// is only accepted where one can start, and a sign applies to a power.
+ParseResult* Parser::unary_expr(int min_precedence) {
+    Token token = current_token;
+    if (min_precedence <= COMPARISON_PRECEDENCE && token.matches(KEYWORD_TOKEN, "not")) {
+        ParseResult* res = new ParseResult();
         res->reg_advancement();
         advance();
-        Node* node = res->reg(comp_expr());
-        if (res->error->err_name != "") {
+        Node* node = res->reg(binary_expr(COMPARISON_PRECEDENCE));
+        if (res->error != nullptr) {
             return res;
         }
-        return res->success(new UnaryOpNode(op, node));
-    } else {
-        Node* node = res->reg(bin_op(&Parser::arith_expr, {EE_TOKEN, NE_TOKEN, LT_TOKEN, GT_TOKEN, LTE_TOKEN, GTE_TOKEN}));
-        if (res->error->err_name != "") {
-            return res->failure(new InvalidSyntaxError(current_token.pos_start, current_token.pos_end, "Expected 'not', INT, FLOAT, IDENTIFIER, '+', '-', '[' or '('"));
+        return res->success(new UnaryOpNode(token, node));
+    }
+    if (token.type == PLUS_TOKEN || token.type == MINUS_TOKEN) {
+        ParseResult* res = new ParseResult();
+        res->reg_advancement();
+        advance();
+        ParseResult* operand_res = binary_expr(POWER_PRECEDENCE);
+        if (operand_res->error != nullptr) {
+            return operand_res;
         }
-        return res->success(node);
+        return res->success(new UnaryOpNode(token, operand_res->ast));
     }
-}
-
-ParseResult* Parser::arith_expr() {
-    return bin_op(&Parser::term, {PLUS_TOKEN, MINUS_TOKEN});
+    return call();
 }
 
 ParseResult* Parser::list_expr() {
@@ -1658,14 +2977,14 @@ ParseResult* Parser::list_expr() {
         advance();
     } else {
         elements.push_back(res->reg(expr()));
-        if (res->error->err_name != "") {
+        if (res->error != nullptr) {
             return res->failure(new InvalidSyntaxError(current_token.pos_start, current_token.pos_end, "Expected ']', 'var', 'if', 'for', 'while', 'func', INT, FLOAT, IDENTIFIER, '+', '-', '[' or '('"));
         }
         while (current_token.type == COMMA_TOKEN) {
             res->reg_advancement();
             advance();
             elements.push_back(res->reg(expr()));
-            if (res->error->err_name != "") {
+            if (res->error != nullptr) {
                 return res;
             }
         }
@@ -1680,31 +2999,171 @@ ParseResult* Parser::list_expr() {
 
 // ************CONTEXT************
 
-Context::Context(std::string display_name, Context* parent, Position parent_entry_pos) 
-    : display_name(display_name), parent(parent), parent_entry_pos(parent_entry_pos), symbol_table(SymbolTable()) {}
+Context::Context(std::string_view display_name, Context* parent, Position parent_entry_pos) 
+    : display_name(display_name), parent(parent), parent_entry_pos(parent_entry_pos) {}
+
+Context::Context() : display_name(""), parent(nullptr), parent_entry_pos(Position()) {}
+
+// Returns the innermost bound variable with this symbol, or nullptr
+Value* Context::lookup(int symbol) {
+    for (Context* context = this; context != nullptr && context->locals != nullptr; context = context->parent) {
+        // the last of two arguments with the same name is the one that is visible
+        for (int slot = context->locals->size() - 1; slot >= 0; slot--) {
+            if ((*context->locals)[slot] == symbol && context->slots[slot].is_bound()) {
+                return &context->slots[slot];
+            }
+        }
+    }
+    Value& value = global_symbol_table.values[symbol];
+    return value.is_bound() ? &value : nullptr;
+}
+
+// Returns the bound value of a resolved variable in place, or nullptr
+Value* Context::get(int slot, int symbol) {
+    if (slot >= 0) {
+        if (slots[slot].is_bound()) {
+            return &slots[slot];
+        }
+        // not assigned yet in this call, so a caller's or a global one is visible
+        if (parent != nullptr) {
+            return parent->lookup(symbol);
+        }
+    } else if (global_symbol_table.shadows[symbol] != 0) {
+        return lookup(symbol);
+    }
+    // no function has a local of this name, so only the global can be bound
+    Value& value = global_symbol_table.values[symbol];
+    return value.is_bound() ? &value : nullptr;
+}
+
+void Context::set(int slot, int symbol, Value value) {
+    if (slot >= 0) {
+        slots[slot] = value;
+    } else {
+        global_symbol_table.bind(symbol, value);
+    }
+}
+
+FrameStack frames = FrameStack();
+
+Value* FrameStack::push(size_t count) {
+    if (blocks.empty() || blocks[top].used + count > blocks[top].values.size()) {
+        // frames don't straddle blocks, so this one starts the next block
+        if (!blocks.empty()) {
+            top++;
+        }
+        if (top == blocks.size()) {
+            blocks.push_back(Block{std::vector<Value>(std::max(BLOCK_SIZE, count)), 0});
+        } else if (blocks[top].values.size() < count) {
+            blocks[top].values = std::vector<Value>(count);
+        }
+    }
+    Block& block = blocks[top];
+    Value* slots = block.values.data() + block.used;
+    std::fill(slots, slots + count, Value::unbound());
+    block.used += count;
+    return slots;
+}
 
-Context::Context() : display_name(""), parent(nullptr), parent_entry_pos(Position()), symbol_table(SymbolTable()) {}
+void FrameStack::pop(size_t count) {
+    blocks[top].used -= count;
+    if (blocks[top].used == 0 && top > 0) {
+        top--;
+    }
+}
 
 // ************SYMBOL TABLE************
 
-SymbolTable::SymbolTable(SymbolTable* parent) : parent(parent), symbols(std::map<std::string, Value*>()) {}
+// Returns the index of the entry holding the name, or of the empty entry
+// where it would go
+size_t Interner::probe(std::string_view name, uint64_t hash) const {
+    size_t mask = table.size() - 1;
+    size_t index = (hash ^ (hash >> 32)) & mask;
+    while (table[index].symbol >= 0 && (table[index].hash != hash || names[table[index].symbol] != name)) {
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+void Interner::grow() {
+    std::vector<Entry> old_table = std::move(table);
+    table.assign(old_table.empty() ? 256 : old_table.size() * 2, Entry{0, -1});
+    size_t mask = table.size() - 1;
+    for (const Entry& entry : old_table) {
+        if (entry.symbol >= 0) {
+            size_t index = (entry.hash ^ (entry.hash >> 32)) & mask;
+            while (table[index].symbol >= 0) {
+                index = (index + 1) & mask;
+            }
+            table[index] = entry;
+        }
+    }
+}
 
-Value* SymbolTable::get(std::string name) {
-    if (symbols.find(name) != symbols.end()) {
-        return symbols[name];
+// Returns the symbol of a name, adding the name if it is new
+int Interner::intern(std::string_view name) {
+    if ((names.size() + 1) * 2 > table.size()) {
+        grow();
     }
-    if (parent != nullptr) {
-        return parent->get(name);
+    uint64_t hash = checksum(name);
+    Entry& entry = table[probe(name, hash)];
+    if (entry.symbol < 0) {
+        names.push_back(std::string(name));
+        entry = Entry{hash, static_cast<int>(names.size() - 1)};
+    }
+    return entry.symbol;
+}
+
+int Interner::find(std::string_view name) const {
+    if (table.empty()) {
+        return -1;
+    }
+    return table[probe(name, checksum(name))].symbol;
+}
+
+std::string_view Interner::name(int symbol) const {
+    return names[symbol];
+}
+
+int Interner::size() const {
+    return names.size();
+}
+
+// Returns the symbol of a name, adding an unbound global for it if it is new
+int SymbolTable::symbol(std::string_view name) {
+    int symbol = interner.intern(name);
+    if (static_cast<size_t>(symbol) >= values.size()) {
+        values.resize(interner.size(), Value::unbound());
+        shadows.resize(interner.size(), 0);
+        versions.resize(interner.size(), 0);
+    }
+    return symbol;
+}
+
+// Returns the bound value in place, or nullptr if the name is unbound
+Value* SymbolTable::get(std::string_view name) {
+    int symbol = interner.find(name);
+    if (symbol < 0 || static_cast<size_t>(symbol) >= values.size() || !values[symbol].is_bound()) {
+        return nullptr;
     }
-    return nullptr;
+    return &values[symbol];
+}
+
+// Every assignment to a global goes through here, so that calls that cached it see the change
+void SymbolTable::bind(int symbol, Value value) {
+    values[symbol] = value;
+    versions[symbol]++;
 }
 
-void SymbolTable::set(std::string name, Value* value) {
-    symbols[name] = value;
+void SymbolTable::set(std::string_view name, Value value) {
+    bind(symbol(name), value);
 }
 
-void SymbolTable::remove(std::string name) {
-    symbols.erase(name);
+void SymbolTable::remove(std::string_view name) {
+    int symbol = interner.find(name);
+    if (symbol >= 0 && static_cast<size_t>(symbol) < values.size()) {
+        bind(symbol, Value::unbound());
+    }
 }
 
 // ************INTERPRETER************
@@ -1713,63 +3172,42 @@ Interpreter::Interpreter(ParseResult* parse_result) : parse_result(parse_result)
 
 template <typename T>
 RuntimeResult Interpreter::visit(T* node, Context& context) {
-    if (auto num = dynamic_cast<NumberNode*>(node)) {
-        return visit_NumberNode(num, context);
-    } else if (auto bin = dynamic_cast<BinOpNode*>(node)) {
-        return visit_BinOpNode(bin, context);
-    } else if (auto un = dynamic_cast<UnaryOpNode*>(node)) {
-        return visit_UnaryOpNode(un, context);
-    } else if (auto var = dynamic_cast<VarAccessNode*>(node)) {
-        return visit_VarAccessNode(var, context);
-    } else if (auto var = dynamic_cast<VarAssignNode*>(node)) {
-        return visit_VarAssignNode(var, context);
-    } else if (auto if_node = dynamic_cast<IfNode*>(node)) {
-        return visit_IfNode(if_node, context);
-    } else if (auto for_node = dynamic_cast<ForNode*>(node)) {
-        return visit_ForNode(for_node, context);
-    } else if (auto while_node = dynamic_cast<WhileNode*>(node)) {
-        return visit_WhileNode(while_node, context);
-    } else if (auto func_def = dynamic_cast<FuncDefNode*>(node)) {
-        return visit_FuncDefNode(func_def, context);
-    } else if (auto call = dynamic_cast<CallNode*>(node)) {
-        return visit_CallNode(call, context);
-    } else if (auto str = dynamic_cast<StringNode*>(node)) {
-        return visit_StringNode(str, context);
-    } else if (auto list = dynamic_cast<ListNode*>(node)) {
-        return visit_ListNode(list, context);
-    } else if (auto continue_ = dynamic_cast<ContinueNode*>(node)) {
-        return visit_ContinueNode(continue_, context);
-    } else if (auto break_ = dynamic_cast<BreakNode*>(node)) {
-        return visit_BreakNode(break_, context);
-    } else if (auto return_node = dynamic_cast<ReturnNode*>(node)) {
-        return visit_ReturnNode(return_node, context);
-    } else {
-        return visit_Undefined(node, context);
-    }
+    switch (node->kind) {
+        case NUMBER_NODE: return visit_NumberNode(static_cast<NumberNode*>(node), context);
+        case BIN_OP_NODE: return visit_BinOpNode(static_cast<BinOpNode*>(node), context);
+        case UNARY_OP_NODE: return visit_UnaryOpNode(static_cast<UnaryOpNode*>(node), context);
+        case VAR_ACCESS_NODE: return visit_VarAccessNode(static_cast<VarAccessNode*>(node), context);
+        case VAR_ASSIGN_NODE: return visit_VarAssignNode(static_cast<VarAssignNode*>(node), context);
+        case IF_NODE: return visit_IfNode(static_cast<IfNode*>(node), context);
+        case FOR_NODE: return visit_ForNode(static_cast<ForNode*>(node), context);
+        case WHILE_NODE: return visit_WhileNode(static_cast<WhileNode*>(node), context);
+        case FUNC_DEF_NODE: return visit_FuncDefNode(static_cast<FuncDefNode*>(node), context);
+        case CALL_NODE: return visit_CallNode(static_cast<CallNode*>(node), context);
+        case STRING_NODE: return visit_StringNode(static_cast<StringNode*>(node), context);
+        case LIST_NODE: return visit_ListNode(static_cast<ListNode*>(node), context);
+        case CONTINUE_NODE: return visit_ContinueNode(static_cast<ContinueNode*>(node), context);
+        case BREAK_NODE: return visit_BreakNode(static_cast<BreakNode*>(node), context);
+        case RETURN_NODE: return visit_ReturnNode(static_cast<ReturnNode*>(node), context);
+    }
+    return visit_Undefined(node, context);
 }
 
 RuntimeResult Interpreter::visit_VarAccessNode(VarAccessNode* node, Context& context) {
     RuntimeResult rt_result = RuntimeResult();
-    std::string var_name = node->var_name_token.value;
-    Value* value = context.symbol_table.get(var_name);
+    Value* value = context.get(node->slot, node->symbol);
     if (value==nullptr) {
-        return *rt_result.failure(new RuntimeError(node->pos_start, node->pos_end, "Variable '" + var_name + "' is not defined", context));
+        return *rt_result.failure(new RuntimeError(node->pos_start, node->pos_end, "Variable '" + std::string(node->var_name_token.value) + "' is not defined", &context));
     }
-    value = value->copy();
-    value->set_pos(node->pos_start, node->pos_end);
-    value->set_context(context);
-    return *rt_result.success(value);
+    return *rt_result.success(value->copy());
 }
 
 RuntimeResult Interpreter::visit_VarAssignNode(VarAssignNode* node, Context& context) {
     RuntimeResult rt_result = RuntimeResult();
-    std::string var_name = node->var_name_token.value;
-    Value* value = rt_result.reg(visit(node->value_node, context));
+    Value value = rt_result.reg(visit(node->value_node, context));
     if (rt_result.should_return()) {
         return rt_result;
     }
-    value->set_context(context);
-    context.symbol_table.set(var_name, value);
+    context.set(node->slot, node->symbol, value);
     return *rt_result.success(value);
 }
 
@@ -1779,91 +3217,49 @@ RuntimeResult Interpreter::visit_Undefined(Node* node, Context& context) {
 }
 
 RuntimeResult Interpreter::visit_StringNode(StringNode* node, Context& context) {
-    String* str = new String(node->token.value);
-    str->set_context(context);
-    str->set_pos(node->pos_start, node->pos_end);
     RuntimeResult rt_result = RuntimeResult();
-    rt_result.success(str);
+    rt_result.success(Value(new String(node->value)));
     return rt_result;
 }
 
 RuntimeResult Interpreter::visit_NumberNode(NumberNode* node, Context& context) {
-    // check which type of number 
-    Value* no;
-    if (node->token.type == INT_TOKEN) {
-        no = new Number(std::stoll(node->token.value));
-    } else {
-        no = new Number(std::stod(node->token.value));
-    }
-    no->set_context(context);
-    no->set_pos(node->pos_start, node->pos_end);
     RuntimeResult rt_result = RuntimeResult();
-    rt_result.success(no);
+    rt_result.success(node->value);
     return rt_result;
 }
 
 RuntimeResult Interpreter::visit_BinOpNode(BinOpNode* node, Context& context) {
     RuntimeResult rt_result;
-    Value* left = rt_result.reg(visit(node->left, context));
+    RootScope scope;
+    Value left = rt_result.reg(visit(node->left, context));
     if (rt_result.should_return()) {
         return rt_result;
     }
-    Value* right = rt_result.reg(visit(node->right, context));
+    if (left.kind != NUMBER_VALUE) {
+        scope.push(left); // the right operand may run a loop or a call
+    }
+    Value right = rt_result.reg(visit(node->right, context));
     if (rt_result.should_return()) {
         return rt_result;
     }
-    std::pair<Value*, Error*> result(new Number(), nullptr);
-    if (node->op.type == PLUS_TOKEN) {
-        result = left->added_to(right);
-    } else if (node->op.type == MINUS_TOKEN) {
-        result = left->subtracted_by(right);
-    } else if (node->op.type == MUL_TOKEN) {
-        result = left->multiplied_by(right);
-    } else if (node->op.type == DIV_TOKEN) {
-        result = left->divided_by(right);
-    } else if (node->op.type == POWER_TOKEN) {
-        result = left->raised_to(right);
-    } else if (node->op.type == EE_TOKEN) {
-        result = left->get_comparison_eq(right);
-    } else if (node->op.type == NE_TOKEN) {
-        result = left->get_comparison_ne(right);
-    } else if (node->op.type == LT_TOKEN) {
-        result = left->get_comparison_lt(right);
-    } else if (node->op.type == GT_TOKEN) {
-        result = left->get_comparison_gt(right);
-    } else if (node->op.type == LTE_TOKEN) {
-        result = left->get_comparison_lte(right);
-    } else if (node->op.type == GTE_TOKEN) {
-        result = left->get_comparison_gte(right);
-    } else if (node->op.matches(KEYWORD_TOKEN, "and")) {
-        result = left->anded_with(right);
-    } else if (node->op.matches(KEYWORD_TOKEN, "or")) {
-        result = left->ored_with(right);
-    }
-    if (result.second->err_name != "") {
+    std::pair<Value, Error*> result = VM::binary_operation(node->op_code, left, right);
+    if (result.second != nullptr) {
+        // operators don't know where they were applied, so place their errors here
+        if (result.second->pos_start.file_id == 0) {
+            static_cast<RuntimeError*>(result.second)->set_pos(node->pos_start, node->pos_end);
+        }
         return *rt_result.failure(result.second);
     }
-    result.first->set_pos(node->pos_start, node->pos_end);
     return *rt_result.success(result.first);
 }
 
 RuntimeResult Interpreter::visit_UnaryOpNode(UnaryOpNode* node, Context& context) {
     RuntimeResult rt_result;
-    Number* no = static_cast<Number*>(rt_result.reg(visit(node->node, context)));
+    Value no = rt_result.reg(visit(node->node, context));
     if (rt_result.should_return()) {
         return rt_result;
     }
-    std::pair<Value*, Error*> result;
-    if (node->op.type == PLUS_TOKEN) {
-        result.first = no;
-    } else if (node->op.type == MINUS_TOKEN) {
-        Number minus_one = Number(static_cast<int64_t>(-1));
-        result = no->multiplied_by(&minus_one);
-    } else if (node->op.matches(KEYWORD_TOKEN, "not")) {
-        result = no->notted();
-    }
-    result.first->set_pos(node->pos_start, node->pos_end);
-    rt_result.success(result.first);
+    rt_result.success(unary_operation(node->op, no).first);
     return rt_result;
 }
 
@@ -1871,66 +3267,69 @@ RuntimeResult Interpreter::visit_IfNode(IfNode* node, Context& context) {
     RuntimeResult rt_result;
     for (int i = 0; i < node->cases.size(); i++) {
         std::tuple<Node*, Node*, bool> case_ = node->cases[i];
-        Value* condition = rt_result.reg(visit(std::get<0>(case_), context));
-        Node* expr = std::get<1>(case_);
         bool should_return_null = i == std::get<2>(case_);
-        if (rt_result.should_return()) {
-            return rt_result;
+        // the Optimizer leaves no condition on a case that is always taken
+        bool taken = true;
+        if (std::get<0>(case_) != nullptr) {
+            Value condition = rt_result.reg(visit(std::get<0>(case_), context));
+            if (rt_result.should_return()) {
+                return rt_result;
+            }
+            taken = condition.is_true();
         }
-        if (condition->is_true()) {
-            Value* expr = rt_result.reg(visit(std::get<1>(case_), context));
+        if (taken) {
+            Value expr = rt_result.reg(visit(std::get<1>(case_), context));
             if (rt_result.should_return()) {
                 return rt_result;
             }
             if (should_return_null) {
-                return *rt_result.success(new Number(static_cast<int64_t>(0)));
+                return *rt_result.success(Value(static_cast<int64_t>(0)));
             } else {
                 return *rt_result.success(expr);
             }
         }
     }
-    return *rt_result.success(new Number(static_cast<int64_t>(0)));
+    return *rt_result.success(Value(static_cast<int64_t>(0)));
 }
 
 RuntimeResult Interpreter::visit_ForNode(ForNode* node, Context& context) {
     RuntimeResult rt_result;
-    std::vector<Value*> elements;
+    RootScope scope; // the bounds, then the elements of the result
     
     // start value
-    Value* start_val = rt_result.reg(visit(node->start_value_node, context));
+    Value start = rt_result.reg(visit(node->start_value_node, context));
     if (rt_result.should_return()) {
         return rt_result;
     }
-    const Number* start = static_cast<Number*>(start_val);
+    scope.push(start);
 
     // end value  
-    Value* end_val = rt_result.reg(visit(node->end_value_node, context));
+    Value end_value = rt_result.reg(visit(node->end_value_node, context));
     if (rt_result.should_return()) {
         return rt_result;
     }
-    const Number* end_value = static_cast<Number*>(end_val);
+    scope.push(end_value);
 
     // step value (default = 1)
-    const Number* step = nullptr;
+    Value step = Value(static_cast<int64_t>(1));
     if (node->step_value_node) {
-        Value* step_val = rt_result.reg(visit(node->step_value_node, context));
+        step = rt_result.reg(visit(node->step_value_node, context));
         if (rt_result.should_return()) {
             return rt_result;
         }
-        step = static_cast<Number*>(step_val);
-    } else {
-        step = new Number(static_cast<int64_t>(1));
     }
-    SymbolTable& symbol_table = context.symbol_table;
-    const std::string& var_name = node->var_name_token.value;
     Node* body_node = node->body_node;
-    Value* result = new Number();
-    if (start->type==Number::INTEGER && end_value->type==Number::INTEGER && step->type==Number::INTEGER) {
-        int64_t start_value = start->getAsInt();
-        int64_t end = end_value->getAsInt();
-        int64_t step_value = step->getAsInt();
+    Value result;
+    heap.roots.resize(scope.base); // the bounds are only read as numbers from here on
+    if (start.type==Value::INTEGER && end_value.type==Value::INTEGER && step.type==Value::INTEGER) {
+        int64_t start_value = start.getAsInt();
+        int64_t end = end_value.getAsInt();
+        int64_t step_value = step.getAsInt();
         for (int64_t i = start_value; i < end; i += step_value) {
-            symbol_table.set(var_name, new Number(i));
+            if (heap.should_collect()) {
+                heap.collect();
+            }
+            context.set(node->slot, node->symbol, Value(i));
             result = rt_result.reg(visit(body_node, context));
             if (rt_result.should_return() && rt_result.loop_should_continue==false && rt_result.loop_should_break==false) {
                 return rt_result;
@@ -1941,14 +3340,19 @@ RuntimeResult Interpreter::visit_ForNode(ForNode* node, Context& context) {
             if (rt_result.loop_should_break) {
                 break;
             }
-            elements.push_back(result->copy());
+            if (!node->should_return_null) {
+                scope.push(result.copy());
+            }
         }
     } else {
-        double start_value = start->getAsFloat();
-        double end = end_value->getAsFloat();
-        double step_value = step->getAsFloat();
+        double start_value = start.getAsFloat();
+        double end = end_value.getAsFloat();
+        double step_value = step.getAsFloat();
         for (double i = start_value; i < end; i += step_value) {
-            symbol_table.set(var_name, new Number(i));
+            if (heap.should_collect()) {
+                heap.collect();
+            }
+            context.set(node->slot, node->symbol, Value(i));
             result = rt_result.reg(visit(body_node, context));
             if (rt_result.should_return() && rt_result.loop_should_continue==false && rt_result.loop_should_break==false) {
                 return rt_result;
@@ -1959,31 +3363,32 @@ RuntimeResult Interpreter::visit_ForNode(ForNode* node, Context& context) {
             if (rt_result.loop_should_break) {
                 break;
             }
-            elements.push_back(result->copy());
+            if (!node->should_return_null) {
+                scope.push(result.copy());
+            }
         }
     }
-    List* list = new List(elements);
-    list->set_context(context);
-    list->set_pos(node->pos_start, node->pos_end);
     if (node->should_return_null) {
-        return *rt_result.success(new Number(static_cast<int64_t>(0)));
-    } else {
-        return *rt_result.success(list);
+        return *rt_result.success(Value(static_cast<int64_t>(0)));
     }
+    return *rt_result.success(Value(new List(scope.values())));
 }
 
 RuntimeResult Interpreter::visit_WhileNode(WhileNode* node, Context& context) {
     RuntimeResult rt_result;
-    std::vector<Value*> elements;
+    RootScope scope; // the elements of the result
     Node* const condition_node = node->condition_node;
     Node* const body_node = node->body_node;
-    Value* result;
+    Value result;
     while (true) {
-        Value* condition = rt_result.reg(visit(condition_node, context));
+        if (heap.should_collect()) {
+            heap.collect();
+        }
+        Value condition = rt_result.reg(visit(condition_node, context));
         if (rt_result.should_return()) {
             return rt_result;
         }
-        if (!condition->is_true()) {
+        if (!condition.is_true()) {
             break;
         }
         result = rt_result.reg(visit(body_node, context));
@@ -1996,40 +3401,32 @@ RuntimeResult Interpreter::visit_WhileNode(WhileNode* node, Context& context) {
         if (rt_result.loop_should_break) {
             break;
         }
-        elements.push_back(result);
+        if (!node->should_return_null) {
+            scope.push(result);
+        }
     }
-    List* list = new List(elements);
-    list->set_context(context);
-    list->set_pos(node->pos_start, node->pos_end);
     if (node->should_return_null) {
-        return *rt_result.success(new Number(static_cast<int64_t>(0)));
-    } else {
-        return *rt_result.success(list);
+        return *rt_result.success(Value(static_cast<int64_t>(0)));
     }
+    return *rt_result.success(Value(new List(scope.values())));
 }
 
 RuntimeResult Interpreter::visit_FuncDefNode(FuncDefNode* node, Context& context) {
     RuntimeResult res = RuntimeResult();
-    Token func_name;
-    const std::string& file_name = node->pos_start.file_name;
-    const std::string& file_text = node->pos_start.file_text;
-    func_name = node->var_name_token;
-    Function* func = new Function(func_name, node->arg_name_tokens, node->body_node, node->should_auto_return);
-    func->set_context(context);
-    func->set_pos(node->pos_start, node->pos_end);
+    Function* func = new Function(node->var_name_token, &node->arg_name_tokens, node->body_node, node->should_auto_return);
+    func->locals = &node->locals;
+    func->hold(node->arena);
 
-    if (context.symbol_table.get(func_name.value) == nullptr) {
-        context.symbol_table.set(func_name.value, func);
+    if (node->symbol >= 0 && context.get(node->slot, node->symbol) == nullptr) {
+        context.set(node->slot, node->symbol, func);
     }
 
-    func->pos_start.file_name = file_name;
-    func->pos_start.file_text = file_text;
-    return *res.success(func);
+    return *res.success(Value(func));
 }
 
 RuntimeResult Interpreter::visit_ReturnNode(ReturnNode* node, Context& context) {
     RuntimeResult rt_result;
-    Value* value = new Number(static_cast<int64_t>(0));
+    Value value = Value(static_cast<int64_t>(0));
     if (node->node_to_return) {
         value = rt_result.reg(visit(node->node_to_return, context));
         if (rt_result.should_return()) {
@@ -2051,146 +3448,916 @@ RuntimeResult Interpreter::visit_BreakNode(BreakNode* node, Context& context) {
 
 RuntimeResult Interpreter::visit_CallNode(CallNode* node, Context& context) {
     RuntimeResult rt_result;
-    std::vector<Value*> args;
-    
-    const std::string& file_name = node->pos_start.file_name;
-    const std::string& file_text = node->pos_start.file_text;
-    const int line_num = node->pos_start.line;
-    const int col_num = node->pos_start.col;
+    RootScope scope; // the callee, which evaluating the arguments could unbind
+
+    Value value;
+    if (node->cached_callee != nullptr && global_symbol_table.versions[node->cached_symbol] == node->cached_version) {
+        value = Value(node->cached_callee);
+    } else {
+        value = rt_result.reg(visit(node->node_to_call, context));
+        if (rt_result.should_return()) {
+            if (rt_result.error != nullptr) {
+                rt_result.error->set_start(node->pos_start);
+            }
+            return rt_result;
+        }
+
+        if (!value.is_callable()) {
+            return *rt_result.failure(new RuntimeError(node->pos_start, node->pos_end, "Cannot call a non-function value", &context));
+        }
 
-    std::string func_to_call_name = (dynamic_cast<VarAccessNode*>(node->node_to_call))->var_name_token.value;
-    if (func_to_call_name.empty()) {
-        func_to_call_name = "<anonymous>";
+        // a callee that can only be the global (see Context::get) is cached
+        // until the global is bound again or a function gets a local of its name
+        if (node->node_to_call->kind == VAR_ACCESS_NODE) {
+            VarAccessNode* access = static_cast<VarAccessNode*>(node->node_to_call);
+            if (access->slot < 0 && global_symbol_table.shadows[access->symbol] == 0) {
+                node->cached_callee = value.object;
+                node->cached_symbol = access->symbol;
+                node->cached_version = global_symbol_table.versions[access->symbol];
+            }
+        }
     }
 
-    Value* value = rt_result.reg(visit(node->node_to_call, context));
-    if (rt_result.should_return()) {
-        rt_result.error->pos_start.file_name = file_name;
-        rt_result.error->pos_start.file_text = file_text;
-        rt_result.error->pos_start.line = line_num;
-        rt_result.error->pos_start.col = col_num;
-        return rt_result;
+    scope.push(value);
+
+    // the arguments are evaluated into slots on the frame stack
+    size_t argc = node->args.size();
+    Value* args = frames.push(argc);
+    for (size_t i = 0; i < argc; i++) {
+        args[i] = rt_result.reg(visit(node->args[i], context));
+        if (rt_result.should_return()) {
+            frames.pop(argc);
+            if (rt_result.error != nullptr) {
+                rt_result.error->set_start(node->pos_start);
+            }
+            return rt_result;
+        }
     }
-    
-    BaseFunction* func = dynamic_cast<BaseFunction*>(value);
-    if (!func) {
-        return *rt_result.failure(new RuntimeError(node->pos_start, node->pos_end, "Cannot call a non-function value", context));
+
+    if (heap.should_collect()) {
+        heap.collect();
     }
 
-    func = static_cast<BaseFunction*>(func->copy());
-    func->set_pos(node->pos_start, node->pos_end);
+    if (node->tail_call && value.kind == FUNCTION_VALUE) {
+        Function* func = static_cast<Function*>(value.object);
+        if (func->locals == context.locals && argc == func->arg_name_tokens->size()) {
+            // the running function returns a call to itself, so its frame is
+            // refilled and Function::execute runs the body again
+            func->populate_args(Arguments{args, argc}, context);
+            frames.pop(argc);
+            return *rt_result.success_tail_call();
+        }
+    }
 
-    if (!func) {
-        return *rt_result.failure(new RuntimeError(node->pos_start, node->pos_end, "Expected function", context));
+    RuntimeResult result = value.object->execute(Arguments{args, argc}, CallSite{node->pos_start, node->pos_end, node->display_name});
+    frames.pop(argc);
+    if (result.error != nullptr) {
+        result.error->set_start(node->pos_start);
+        return *rt_result.failure(result.error);
     }
 
-    for (Node* arg_node : node->args) {
-        args.push_back(rt_result.reg(visit(arg_node, context)));
+    return *rt_result.success(result.value.copy());
+}
+
+RuntimeResult Interpreter::visit_ListNode(ListNode* node, Context& context) {
+    RuntimeResult rt_result;
+    RootScope scope; // the elements so far
+
+    for (Node* element_node : node->elements) {
+        RuntimeResult element_result = visit(element_node, context);
+        Value element = rt_result.reg(element_result);
         if (rt_result.should_return()) {
-            rt_result.error->pos_start.file_name = file_name;
-            rt_result.error->pos_start.file_text = file_text;
-            rt_result.error->pos_start.line = line_num;
-            rt_result.error->pos_start.col = col_num;
             return rt_result;
         }
+        if (!node->should_return_null) {
+            scope.push(element);
+        }
+    }
+    if (node->should_return_null) {
+        return *rt_result.success(Value(static_cast<int64_t>(0)));
+    }
+    List* list = new List(scope.values());
+    rt_result.success(Value(list->copy()));
+    return rt_result;
+}
+
+// Applies a unary operator token to its operand, for the Interpreter and the Optimizer
+std::pair<Value, Error*> Interpreter::unary_operation(const Token& op, Value operand) {
+    if (op.type == MINUS_TOKEN) {
+        return operand.multiplied_by(Value(static_cast<int64_t>(-1)));
+    } else if (op.matches(KEYWORD_TOKEN, "not")) {
+        return operand.notted();
+    }
+    // unary plus leaves its operand as it is
+    return std::pair<Value, Error*>(operand, nullptr);
+}
+
+// ************BYTECODE************
+
+FunctionPrototype::FunctionPrototype(FuncDefNode* definition, Chunk* chunk) : definition(definition), chunk(chunk) {}
+
+FunctionPrototype::~FunctionPrototype() {
+    delete chunk;
+}
+
+Chunk::Chunk() {
+    heap.chunks.insert(this);
+}
+
+// Once the chunk is gone its constants are collected like any other value
+Chunk::~Chunk() {
+    for (FunctionPrototype* prototype : functions) {
+        delete prototype;
+    }
+    heap.chunks.erase(this);
+}
+
+void Chunk::write(OpCode op) {
+    code.push_back(op);
+}
+
+void Chunk::write_operand(uint32_t operand) {
+    uint8_t bytes[4];
+    std::memcpy(bytes, &operand, 4);
+    code.insert(code.end(), bytes, bytes + 4);
+}
+
+uint32_t Chunk::read_operand(int offset) const {
+    uint32_t operand;
+    std::memcpy(&operand, &code[offset], 4);
+    return operand;
+}
+
+void Chunk::patch_operand(int offset, uint32_t operand) {
+    std::memcpy(&code[offset], &operand, 4);
+}
+
+int Chunk::add_constant(Value value) {
+    constants.push_back(value);
+    return constants.size() - 1;
+}
+
+int Chunk::add_span(Position pos_start, Position pos_end) {
+    spans.push_back(std::pair(pos_start, pos_end));
+    return spans.size() - 1;
+}
+
+// ************COMPILER************
+
+Compiler::Compiler() : chunk(new Chunk()), error(nullptr) {}
+
+std::pair<Chunk*, Error*> Compiler::compile(Node* node) {
+    compile_node(node);
+    emit(OP_END, -1);
+    return std::pair(chunk, error);
+}
+
+void Compiler::emit(OpCode op, int stack_effect) {
+    chunk->write(op);
+    stack_depth += stack_effect;
+}
+
+void Compiler::emit(OpCode op, int stack_effect, uint32_t operand) {
+    emit(op, stack_effect);
+    chunk->write_operand(operand);
+}
+
+void Compiler::emit(OpCode op, int stack_effect, uint32_t operand1, uint32_t operand2) {
+    emit(op, stack_effect, operand1);
+    chunk->write_operand(operand2);
+}
+
+void Compiler::emit(OpCode op, int stack_effect, uint32_t operand1, uint32_t operand2, uint32_t operand3) {
+    emit(op, stack_effect, operand1, operand2);
+    chunk->write_operand(operand3);
+}
+
+// emits a jump with a placeholder target and returns the offset of that operand
+int Compiler::emit_jump(OpCode op, int stack_effect) {
+    emit(op, stack_effect, 0);
+    return chunk->code.size() - 4;
+}
+
+void Compiler::patch_jump(int operand_offset, int target) {
+    chunk->patch_operand(operand_offset, target);
+}
+
+int Compiler::span(Node* node) {
+    return chunk->add_span(node->pos_start, node->pos_end);
+}
+
+void Compiler::compile_node(Node* node) {
+    if (error != nullptr) {
+        return;
+    }
+    switch (node->kind) {
+        case NUMBER_NODE: return compile_NumberNode(static_cast<NumberNode*>(node));
+        case BIN_OP_NODE: return compile_BinOpNode(static_cast<BinOpNode*>(node));
+        case UNARY_OP_NODE: return compile_UnaryOpNode(static_cast<UnaryOpNode*>(node));
+        case VAR_ACCESS_NODE: return compile_VarAccessNode(static_cast<VarAccessNode*>(node));
+        case VAR_ASSIGN_NODE: return compile_VarAssignNode(static_cast<VarAssignNode*>(node));
+        case IF_NODE: return compile_IfNode(static_cast<IfNode*>(node));
+        case FOR_NODE: return compile_ForNode(static_cast<ForNode*>(node));
+        case WHILE_NODE: return compile_WhileNode(static_cast<WhileNode*>(node));
+        case FUNC_DEF_NODE: return compile_FuncDefNode(static_cast<FuncDefNode*>(node));
+        case CALL_NODE: return compile_CallNode(static_cast<CallNode*>(node));
+        case STRING_NODE: return compile_StringNode(static_cast<StringNode*>(node));
+        case LIST_NODE: return compile_ListNode(static_cast<ListNode*>(node));
+        case CONTINUE_NODE: return compile_ContinueNode(static_cast<ContinueNode*>(node));
+        case BREAK_NODE: return compile_BreakNode(static_cast<BreakNode*>(node));
+        case RETURN_NODE: return compile_ReturnNode(static_cast<ReturnNode*>(node));
+    }
+    throw std::runtime_error("Undefined Node Type");
+}
+
+void Compiler::compile_NumberNode(NumberNode* node) {
+    emit(OP_CONSTANT, 1, chunk->add_constant(node->value));
+}
+
+void Compiler::compile_StringNode(StringNode* node) {
+    emit(OP_CONSTANT, 1, chunk->add_constant(Value(new String(node->value))));
+}
+
+void Compiler::compile_BinOpNode(BinOpNode* node) {
+    compile_node(node->left);
+    compile_node(node->right);
+    emit(node->op_code, -1, span(node));
+}
+
+void Compiler::compile_UnaryOpNode(UnaryOpNode* node) {
+    compile_node(node->node);
+    // unary plus leaves its operand as it is
+    if (node->op.type == MINUS_TOKEN) {
+        emit(OP_NEGATE, 0);
+    } else if (node->op.matches(KEYWORD_TOKEN, "not")) {
+        emit(OP_NOT, 0);
+    }
+}
+
+void Compiler::compile_VarAccessNode(VarAccessNode* node) {
+    if (node->slot >= 0) {
+        emit(OP_LOAD_LOCAL, 1, node->slot, span(node));
+    } else {
+        emit(OP_LOAD_GLOBAL, 1, node->symbol, span(node));
+    }
+}
+
+void Compiler::compile_VarAssignNode(VarAssignNode* node) {
+    compile_node(node->value_node);
+    if (node->slot >= 0) {
+        emit(OP_STORE_LOCAL, 0, node->slot);
+    } else {
+        emit(OP_STORE_GLOBAL, 0, node->symbol);
+    }
+}
+
+void Compiler::compile_IfNode(IfNode* node) {
+    std::vector<int> end_jumps;
+    bool always_taken = false;
+    for (size_t i = 0; i < node->cases.size(); i++) {
+        std::tuple<Node*, Node*, bool> case_ = node->cases[i];
+        // a case the Optimizer left without a condition is always taken and is the last one
+        always_taken = std::get<0>(case_) == nullptr;
+        int next_case = -1;
+        if (!always_taken) {
+            compile_node(std::get<0>(case_));
+            next_case = emit_jump(OP_JUMP_IF_FALSE, -1);
+        }
+        compile_node(std::get<1>(case_));
+        // mirrors visit_IfNode, which compares the case index with the multi-line flag
+        bool should_return_null = i == std::get<2>(case_);
+        if (should_return_null) {
+            emit(OP_POP, -1);
+            emit(OP_NULL, 1);
+        }
+        if (always_taken) {
+            break;
+        }
+        end_jumps.push_back(emit_jump(OP_JUMP, 0));
+        stack_depth--; // the case value is accounted for where the cases meet
+        patch_jump(next_case, chunk->code.size());
+    }
+    if (!always_taken) {
+        emit(OP_NULL, 1);
+    }
+    for (int end_jump : end_jumps) {
+        patch_jump(end_jump, chunk->code.size());
+    }
+}
+
+void Compiler::compile_ForNode(ForNode* node) {
+    if (!node->should_return_null) {
+        emit(OP_NEW_LIST, 1);
+    }
+    compile_node(node->start_value_node);
+    compile_node(node->end_value_node);
+    compile_node(node->step_value_node);
+    emit(OP_FOR_PREP, -3 + 3);
+
+    int loop_start = chunk->code.size();
+    emit(OP_FOR_ITER, 0, node->slot, node->symbol, 0);
+    int exit_jump = chunk->code.size() - 4;
+
+    loops.push_back(Loop{stack_depth, -1});
+    compile_node(node->body_node);
+    if (node->should_return_null) {
+        emit(OP_POP, -1);
+    } else {
+        emit(OP_LIST_APPEND_COPY, -1, 4);
+    }
+    Loop loop = loops.back();
+    loops.pop_back();
+
+    for (int continue_jump : loop.continue_jumps) {
+        patch_jump(continue_jump, chunk->code.size());
+    }
+    emit(OP_FOR_STEP, 0);
+    emit(OP_JUMP, 0, loop_start);
+
+    patch_jump(exit_jump, chunk->code.size());
+    for (int break_jump : loop.break_jumps) {
+        patch_jump(break_jump, chunk->code.size());
+    }
+    emit(OP_POP_N, -3, 3);
+    if (node->should_return_null) {
+        emit(OP_NULL, 1);
+    }
+}
+
+void Compiler::compile_WhileNode(WhileNode* node) {
+    if (!node->should_return_null) {
+        emit(OP_NEW_LIST, 1);
+    }
+
+    int loop_start = chunk->code.size();
+    compile_node(node->condition_node);
+    int exit_jump = emit_jump(OP_JUMP_IF_FALSE, -1);
+
+    loops.push_back(Loop{stack_depth, loop_start});
+    compile_node(node->body_node);
+    if (node->should_return_null) {
+        emit(OP_POP, -1);
+    } else {
+        emit(OP_LIST_APPEND, -1, 1);
+    }
+    Loop loop = loops.back();
+    loops.pop_back();
+    emit(OP_JUMP, 0, loop_start);
+
+    patch_jump(exit_jump, chunk->code.size());
+    for (int break_jump : loop.break_jumps) {
+        patch_jump(break_jump, chunk->code.size());
+    }
+    if (node->should_return_null) {
+        emit(OP_NULL, 1);
+    }
+}
+
+void Compiler::compile_FuncDefNode(FuncDefNode* node) {
+    Compiler body_compiler = Compiler();
+    std::pair<Chunk*, Error*> body = body_compiler.compile(node->body_node);
+    if (body.second != nullptr) {
+        delete body.first;
+        error = body.second;
+        return;
+    }
+    chunk->functions.push_back(new FunctionPrototype(node, body.first));
+    emit(OP_MAKE_FUNCTION, 1, chunk->functions.size() - 1);
+}
+
+void Compiler::compile_CallNode(CallNode* node) {
+    int start = chunk->code.size();
+    compile_node(node->node_to_call);
+    for (Node* arg_node : node->args) {
+        compile_node(arg_node);
+    }
+    int call_span = span(node);
+    emit(node->tail_call ? OP_TAIL_CALL : OP_CALL, -static_cast<int>(node->args.size()), node->args.size(), interner.intern(node->display_name), call_span);
+    chunk->call_sites.push_back(Chunk::CallSite{start, static_cast<int>(chunk->code.size()), call_span});
+}
+
+void Compiler::compile_ListNode(ListNode* node) {
+    if (node->should_return_null) {
+        for (Node* element_node : node->elements) {
+            compile_node(element_node);
+            emit(OP_POP, -1);
+        }
+        emit(OP_NULL, 1);
+        return;
+    }
+    for (Node* element_node : node->elements) {
+        compile_node(element_node);
+    }
+    emit(OP_BUILD_LIST, 1 - static_cast<int>(node->elements.size()), node->elements.size());
+}
+
+void Compiler::compile_ReturnNode(ReturnNode* node) {
+    if (node->node_to_return) {
+        compile_node(node->node_to_return);
+    } else {
+        emit(OP_NULL, 1);
+    }
+    emit(OP_RETURN, 0);
+}
+
+void Compiler::compile_ContinueNode(ContinueNode* node) {
+    if (loops.empty()) {
+        error = new InvalidSyntaxError(node->pos_start, node->pos_end, "'continue' outside of a loop");
+        return;
+    }
+    Loop& loop = loops.back();
+    int depth = stack_depth;
+    if (depth > loop.stack_depth) {
+        emit(OP_POP_N, loop.stack_depth - depth, depth - loop.stack_depth);
+    }
+    if (loop.continue_target >= 0) {
+        emit(OP_JUMP, 0, loop.continue_target);
+    } else {
+        loop.continue_jumps.push_back(emit_jump(OP_JUMP, 0));
+    }
+    stack_depth = depth + 1; // unreachable, but keeps the enclosing statement balanced
+}
+
+void Compiler::compile_BreakNode(BreakNode* node) {
+    if (loops.empty()) {
+        error = new InvalidSyntaxError(node->pos_start, node->pos_end, "'break' outside of a loop");
+        return;
+    }
+    Loop& loop = loops.back();
+    int depth = stack_depth;
+    if (depth > loop.stack_depth) {
+        emit(OP_POP_N, loop.stack_depth - depth, depth - loop.stack_depth);
+    }
+    loop.break_jumps.push_back(emit_jump(OP_JUMP, 0));
+    stack_depth = depth + 1;
+}
+
+// ************VIRTUAL MACHINE************
+
+std::pair<Value, Error*> VM::binary_operation(OpCode op, Value left, Value right) {
+    switch (op) {
+        case OP_ADD: return left.added_to(right);
+        case OP_SUBTRACT: return left.subtracted_by(right);
+        case OP_MULTIPLY: return left.multiplied_by(right);
+        case OP_DIVIDE: return left.divided_by(right);
+        case OP_POWER: return left.raised_to(right);
+        case OP_EQUAL: return left.get_comparison_eq(right);
+        case OP_NOT_EQUAL: return left.get_comparison_ne(right);
+        case OP_LESS: return left.get_comparison_lt(right);
+        case OP_GREATER: return left.get_comparison_gt(right);
+        case OP_LESS_EQUAL: return left.get_comparison_lte(right);
+        case OP_GREATER_EQUAL: return left.get_comparison_gte(right);
+        case OP_AND: return left.anded_with(right);
+        default: return left.ored_with(right);
+    }
+}
+
+// The specialized form of op for these operands, or op itself if it has none
+OpCode quicken(OpCode op, const Value& left, const Value& right) {
+    if (left.kind != NUMBER_VALUE || right.kind != NUMBER_VALUE) {
+        return op;
+    }
+    bool integers = left.type == Value::INTEGER && right.type == Value::INTEGER;
+    switch (op) {
+        case OP_ADD: return integers ? OP_ADD_INT : OP_ADD_FLOAT;
+        case OP_SUBTRACT: return integers ? OP_SUBTRACT_INT : OP_SUBTRACT_FLOAT;
+        case OP_MULTIPLY: return integers ? OP_MULTIPLY_INT : OP_MULTIPLY_FLOAT;
+        case OP_DIVIDE: return integers ? OP_DIVIDE_INT : OP_DIVIDE_FLOAT;
+        case OP_EQUAL: return OP_EQUAL_NUMBER;
+        case OP_NOT_EQUAL: return OP_NOT_EQUAL_NUMBER;
+        case OP_LESS: return OP_LESS_NUMBER;
+        case OP_GREATER: return OP_GREATER_NUMBER;
+        case OP_LESS_EQUAL: return OP_LESS_EQUAL_NUMBER;
+        case OP_GREATER_EQUAL: return OP_GREATER_EQUAL_NUMBER;
+        default: return op;
+    }
+}
+
+OpCode generic_operation(OpCode op) {
+    switch (op) {
+        case OP_ADD_INT: case OP_ADD_FLOAT: return OP_ADD;
+        case OP_SUBTRACT_INT: case OP_SUBTRACT_FLOAT: return OP_SUBTRACT;
+        case OP_MULTIPLY_INT: case OP_MULTIPLY_FLOAT: return OP_MULTIPLY;
+        case OP_DIVIDE_INT: case OP_DIVIDE_FLOAT: return OP_DIVIDE;
+        case OP_EQUAL_NUMBER: return OP_EQUAL;
+        case OP_NOT_EQUAL_NUMBER: return OP_NOT_EQUAL;
+        case OP_LESS_NUMBER: return OP_LESS;
+        case OP_GREATER_NUMBER: return OP_GREATER;
+        case OP_LESS_EQUAL_NUMBER: return OP_LESS_EQUAL;
+        case OP_GREATER_EQUAL_NUMBER: return OP_GREATER_EQUAL;
+        default: return op;
+    }
+}
+
+// Runs a specialized operator, giving the same result as the generic one.
+// Returns false, leaving result alone, if the operands aren't what it was
+// specialized for; a division by zero also falls back, for the generic error.
+bool quick_operation(OpCode op, const Value& left, const Value& right, Value& result) {
+    if (left.kind != NUMBER_VALUE || right.kind != NUMBER_VALUE) {
+        return false;
+    }
+    bool integers = left.type == Value::INTEGER && right.type == Value::INTEGER;
+    switch (op) {
+        case OP_ADD_INT:
+            if (!integers) return false;
+            result = Value(left.int_value + right.int_value);
+            return true;
+        case OP_ADD_FLOAT:
+            if (integers) return false;
+            result = Value(left.getAsFloat() + right.getAsFloat());
+            return true;
+        case OP_SUBTRACT_INT:
+            if (!integers) return false;
+            result = Value(left.int_value - right.int_value);
+            return true;
+        case OP_SUBTRACT_FLOAT:
+            if (integers) return false;
+            result = Value(left.getAsFloat() - right.getAsFloat());
+            return true;
+        case OP_MULTIPLY_INT:
+            if (!integers) return false;
+            result = Value(left.int_value * right.int_value);
+            return true;
+        case OP_MULTIPLY_FLOAT:
+            if (integers) return false;
+            result = Value(left.getAsFloat() * right.getAsFloat());
+            return true;
+        case OP_DIVIDE_INT:
+            if (!integers || right.int_value == 0) return false;
+            result = Value(left.int_value / right.int_value);
+            return true;
+        case OP_DIVIDE_FLOAT:
+            if (integers || right.getAsFloat() == 0) return false;
+            result = Value(left.getAsFloat() / right.getAsFloat());
+            return true;
+        // numbers are compared as floats, as the generic comparisons do
+        case OP_EQUAL_NUMBER:
+            result = Value(static_cast<int64_t>(left.getAsFloat() == right.getAsFloat()));
+            return true;
+        case OP_NOT_EQUAL_NUMBER:
+            result = Value(static_cast<int64_t>(left.getAsFloat() != right.getAsFloat()));
+            return true;
+        case OP_LESS_NUMBER:
+            result = Value(static_cast<int64_t>(left.getAsFloat() < right.getAsFloat()));
+            return true;
+        case OP_GREATER_NUMBER:
+            result = Value(static_cast<int64_t>(left.getAsFloat() > right.getAsFloat()));
+            return true;
+        case OP_LESS_EQUAL_NUMBER:
+            result = Value(static_cast<int64_t>(left.getAsFloat() <= right.getAsFloat()));
+            return true;
+        case OP_GREATER_EQUAL_NUMBER:
+            result = Value(static_cast<int64_t>(left.getAsFloat() >= right.getAsFloat()));
+            return true;
+        default:
+            return false;
+    }
+}
+
+Error* VM::locate_error(Chunk* chunk, int offset, Error* error) {
+    const Chunk::CallSite* outermost = nullptr;
+    for (const Chunk::CallSite& site : chunk->call_sites) {
+        if (site.start <= offset && offset < site.end && (outermost == nullptr || site.start < outermost->start)) {
+            outermost = &site;
+        }
+    }
+    if (outermost != nullptr) {
+        error->set_start(chunk->spans[outermost->span].first);
+    }
+    return error;
+}
+
+RuntimeResult VM::run(Chunk* chunk, Context& context) {
+    RuntimeResult rt_result;
+    uint8_t* code = chunk->code.data(); // written to by quickening
+    int ip = 0;
+    int op_offset = 0;
+    auto read_operand = [&]() {
+        uint32_t operand = chunk->read_operand(ip);
+        ip += 4;
+        return operand;
+    };
+
+    while (true) {
+        op_offset = ip;
+        OpCode op = static_cast<OpCode>(code[ip++]);
+        switch (op) {
+            case OP_CONSTANT: {
+                stack.push_back(chunk->constants[read_operand()].copy());
+                break;
+            }
+            case OP_NULL: {
+                stack.push_back(Value(static_cast<int64_t>(0)));
+                break;
+            }
+            case OP_LOAD_LOCAL:
+            case OP_LOAD_GLOBAL: {
+                uint32_t operand = read_operand();
+                const std::pair<Position, Position>& span = chunk->spans[read_operand()];
+                int slot = op == OP_LOAD_LOCAL ? operand : -1;
+                int symbol = op == OP_LOAD_LOCAL ? (*context.locals)[slot] : operand;
+                Value* value = context.get(slot, symbol);
+                if (value == nullptr) {
+                    return *rt_result.failure(locate_error(chunk, op_offset, new RuntimeError(span.first, span.second, "Variable '" + std::string(interner.name(symbol)) + "' is not defined", &context)));
+                }
+                stack.push_back(value->copy());
+                break;
+            }
+            case OP_STORE_LOCAL: {
+                context.slots[read_operand()] = stack.back();
+                break;
+            }
+            case OP_STORE_GLOBAL: {
+                global_symbol_table.bind(read_operand(), stack.back());
+                break;
+            }
+            case OP_MAKE_FUNCTION: {
+                FunctionPrototype* prototype = chunk->functions[read_operand()];
+                FuncDefNode* definition = prototype->definition;
+                Function* func = new Function(definition->var_name_token, &definition->arg_name_tokens, definition->body_node, definition->should_auto_return);
+                func->chunk = prototype->chunk;
+                func->locals = &definition->locals;
+                func->hold(definition->arena);
+                if (definition->symbol >= 0 && context.get(definition->slot, definition->symbol) == nullptr) {
+                    context.set(definition->slot, definition->symbol, func);
+                }
+                stack.push_back(Value(func));
+                break;
+            }
+            case OP_ADD:
+            case OP_SUBTRACT:
+            case OP_MULTIPLY:
+            case OP_DIVIDE:
+            case OP_POWER:
+            case OP_EQUAL:
+            case OP_NOT_EQUAL:
+            case OP_LESS:
+            case OP_GREATER:
+            case OP_LESS_EQUAL:
+            case OP_GREATER_EQUAL:
+            case OP_AND:
+            case OP_OR: {
+                const std::pair<Position, Position>& span = chunk->spans[read_operand()];
+                Value right = stack.back();
+                stack.pop_back();
+                std::pair<Value, Error*> result = binary_operation(op, stack.back(), right);
+                if (result.second != nullptr) {
+                    // operators don't know where they were applied, so place their errors here
+                    if (result.second->pos_start.file_id == 0) {
+                        static_cast<RuntimeError*>(result.second)->set_pos(span.first, span.second);
+                    }
+                    return *rt_result.failure(locate_error(chunk, op_offset, result.second));
+                }
+                if (chunk->polymorphic.empty() || !chunk->polymorphic[op_offset]) {
+                    code[op_offset] = quicken(op, stack.back(), right);
+                }
+                stack.back() = result.first;
+                break;
+            }
+            case OP_ADD_INT:
+            case OP_ADD_FLOAT:
+            case OP_SUBTRACT_INT:
+            case OP_SUBTRACT_FLOAT:
+            case OP_MULTIPLY_INT:
+            case OP_MULTIPLY_FLOAT:
+            case OP_DIVIDE_INT:
+            case OP_DIVIDE_FLOAT:
+            case OP_EQUAL_NUMBER:
+            case OP_NOT_EQUAL_NUMBER:
+            case OP_LESS_NUMBER:
+            case OP_GREATER_NUMBER:
+            case OP_LESS_EQUAL_NUMBER:
+            case OP_GREATER_EQUAL_NUMBER: {
+                Value& left = stack[stack.size() - 2];
+                if (quick_operation(op, left, stack.back(), left)) {
+                    stack.pop_back();
+                    ip += 4; // the span is only for errors, which the generic operator reports
+                    break;
+                }
+                // the operand types changed, so the instruction runs again as the generic operator for good
+                if (chunk->polymorphic.empty()) {
+                    chunk->polymorphic.resize(chunk->code.size());
+                }
+                chunk->polymorphic[op_offset] = true;
+                code[op_offset] = generic_operation(op);
+                ip = op_offset;
+                break;
+            }
+            case OP_NEGATE: {
+                stack.back() = stack.back().multiplied_by(Value(static_cast<int64_t>(-1))).first;
+                break;
+            }
+            case OP_NOT: {
+                stack.back() = stack.back().notted().first;
+                break;
+            }
+            case OP_BUILD_LIST: {
+                uint32_t count = read_operand();
+                List* list = new List(std::vector<Value>(stack.end() - count, stack.end()));
+                stack.resize(stack.size() - count);
+                stack.push_back(Value(list->copy()));
+                break;
+            }
+            case OP_NEW_LIST: {
+                stack.push_back(Value(new List()));
+                break;
+            }
+            case OP_LIST_APPEND: {
+                uint32_t depth = read_operand();
+                Value value = stack.back();
+                stack.pop_back();
+                stack[stack.size() - depth].as<List>()->elements.push_back(value);
+                break;
+            }
+            case OP_LIST_APPEND_COPY: {
+                uint32_t depth = read_operand();
+                Value value = stack.back();
+                stack.pop_back();
+                stack[stack.size() - depth].as<List>()->elements.push_back(value.copy());
+                break;
+            }
+            case OP_FOR_PREP: {
+                Value& step = stack[stack.size() - 1];
+                Value& end_value = stack[stack.size() - 2];
+                Value& start = stack[stack.size() - 3];
+                if (start.type==Value::INTEGER && end_value.type==Value::INTEGER && step.type==Value::INTEGER) {
+                    start = Value(start.getAsInt());
+                    end_value = Value(end_value.getAsInt());
+                    step = Value(step.getAsInt());
+                } else {
+                    start = Value(start.getAsFloat());
+                    end_value = Value(end_value.getAsFloat());
+                    step = Value(step.getAsFloat());
+                }
+                break;
+            }
+            case OP_FOR_ITER: {
+                int slot = static_cast<int32_t>(read_operand());
+                int symbol = read_operand();
+                uint32_t target = read_operand();
+                const Value& counter = stack[stack.size() - 3];
+                const Value& end = stack[stack.size() - 2];
+                if (counter.type == Value::INTEGER) {
+                    if (counter.int_value >= end.int_value) {
+                        ip = target;
+                        break;
+                    }
+                    context.set(slot, symbol, counter);
+                } else {
+                    if (!(counter.float_value < end.float_value)) {
+                        ip = target;
+                        break;
+                    }
+                    context.set(slot, symbol, counter);
+                }
+                break;
+            }
+            case OP_FOR_STEP: {
+                Value& counter = stack[stack.size() - 3];
+                const Value& step = stack[stack.size() - 1];
+                if (counter.type == Value::INTEGER) {
+                    counter.int_value += step.int_value;
+                } else {
+                    counter.float_value += step.float_value;
+                }
+                break;
+            }
+            case OP_JUMP: {
+                ip = read_operand();
+                if (heap.should_collect()) {
+                    heap.collect();
+                }
+                break;
+            }
+            case OP_JUMP_IF_FALSE: {
+                uint32_t target = read_operand();
+                Value condition = stack.back();
+                stack.pop_back();
+                if (!condition.is_true()) {
+                    ip = target;
+                }
+                break;
+            }
+            case OP_POP: {
+                stack.pop_back();
+                break;
+            }
+            case OP_POP_N: {
+                stack.resize(stack.size() - read_operand());
+                break;
+            }
+            case OP_CALL:
+            case OP_TAIL_CALL: {
+                if (heap.should_collect()) {
+                    heap.collect();
+                }
+                uint32_t argc = read_operand();
+                std::string_view display_name = interner.name(read_operand());
+                const std::pair<Position, Position>& span = chunk->spans[read_operand()];
+                // The callee and its arguments stay on the stack during the call
+                // so that a collection inside it still sees them
+                size_t callee_slot = stack.size() - argc - 1;
+                Value value = stack[callee_slot];
+
+                if (!value.is_callable()) {
+                    return *rt_result.failure(locate_error(chunk, op_offset, new RuntimeError(span.first, span.second, "Cannot call a non-function value", &context)));
+                }
+                if (op == OP_TAIL_CALL && value.kind == FUNCTION_VALUE) {
+                    Function* func = static_cast<Function*>(value.object);
+                    if (func->chunk == chunk && func->locals == context.locals && argc == func->arg_name_tokens->size()) {
+                        // the running function returns a call to itself, so the
+                        // call refills this frame and starts the chunk over
+                        func->populate_args(Arguments{stack.data() + callee_slot + 1, argc}, context);
+                        stack.clear();
+                        ip = 0;
+                        break;
+                    }
+                }
+                // nothing else touches this stack until the call returns
+                RuntimeResult result = value.object->execute(Arguments{stack.data() + callee_slot + 1, argc}, CallSite{span.first, span.second, display_name});
+                if (result.error != nullptr) {
+                    return *rt_result.failure(locate_error(chunk, op_offset, result.error));
+                }
+                stack.resize(callee_slot);
+                stack.push_back(result.value.copy());
+                break;
+            }
+            case OP_RETURN: {
+                return *rt_result.success_return(stack.back());
+            }
+            case OP_END: {
+                return *rt_result.success(stack.back());
+            }
+        }
     }
-
-    if (func->name=="<anonymous>") {
-        func->name = "<" + func_to_call_name + ">";
-    }
-
-    std::pair result = func->execute(args);
-    if (result.second && result.second->err_name != "") {
-        result.second->pos_start.file_name = file_name;
-        result.second->pos_start.file_text = file_text;
-        result.second->pos_start.line = line_num;
-        result.second->pos_start.col = col_num;
-        return *rt_result.failure(result.second);
-    }
-
-    Value* return_value = result.first->value;
-    if (result.first->error->err_name != "") {
-        result.first->error->pos_start.file_name = file_name;
-        result.first->error->pos_start.file_text = file_text; 
-        result.first->error->pos_start.line = line_num;
-        result.first->error->pos_start.col = col_num;
-        return *rt_result.failure(result.first->error);
-    }
-
-    return_value->set_context(context);
-    return_value->set_pos(node->pos_start, node->pos_end);
-    return *rt_result.success(return_value->copy());
 }
 
-RuntimeResult Interpreter::visit_ListNode(ListNode* node, Context& context) {
-    RuntimeResult rt_result;
-    std::vector<Value*> elements;
+// VMs run nested in one another, so they take and give back stacks in order
+VM::VM() : stack(heap.active_stacks < heap.stacks.size() ? heap.stacks[heap.active_stacks] : heap.stacks.emplace_back()) {
+    heap.active_stacks++;
+}
 
-    for (Node* element_node : node->elements) {
-        RuntimeResult element_result = visit(element_node, context);
-        Value* element = rt_result.reg(element_result);
-        if (rt_result.should_return()) {
-            return rt_result;
-        }
-        elements.push_back(element);
-    }
-    List* list = new List(elements);
-    list->set_context(context);
-    list->set_pos(node->pos_start, node->pos_end);
-    rt_result.success(list->copy());
-    return rt_result;
+VM::~VM() {
+    stack.clear();
+    heap.active_stacks--;
 }
 
 // ************RUNTIME RESULT************
 
-RuntimeResult::RuntimeResult() : value(nullptr), error(new Error(Position(), Position(), "", "")) {}
+RuntimeResult::RuntimeResult() : value(Value()), error(nullptr) {}
 
-RuntimeResult::RuntimeResult(Value* value, Error* error) : value(value), error(error) {}
+RuntimeResult::RuntimeResult(Value value, Error* error) : value(value), error(error) {}
 
 void RuntimeResult::reset() {
-    this->value = nullptr;
-    this->error = new Error(Position(), Position(), "", "");
-    this->func_return_value = nullptr;
+    this->value = Value();
+    this->error = nullptr;
+    this->func_return_value = Value();
+    this->func_should_return = false;
+    this->func_should_tail_call = false;
     this->loop_should_continue = false;
     this->loop_should_break = false;
 }
 
-Value* RuntimeResult::reg(RuntimeResult result) {
+Value RuntimeResult::reg(const RuntimeResult& result) {
     if (result.should_return()) {
         this->error = result.error;
     }
     this->func_return_value = result.func_return_value;
+    this->func_should_return = result.func_should_return;
+    this->func_should_tail_call = result.func_should_tail_call;
     this->loop_should_continue = result.loop_should_continue;
     this->loop_should_break = result.loop_should_break;
     return result.value;
 }
 
-bool RuntimeResult::should_return() {
-    if (this->error->err_name != "" || this->func_return_value!=nullptr || this->loop_should_continue || this->loop_should_break) {
-        return true;
-    }
-    return false;
+// The flags are or'ed without short-circuiting so that the check compiles to a
+// single branch on the hot path
+bool RuntimeResult::should_return() const {
+    return (this->error != nullptr) | this->func_should_return | this->func_should_tail_call | this->loop_should_continue | this->loop_should_break;
 }
 
-RuntimeResult* RuntimeResult::success(Value* value) {
+RuntimeResult* RuntimeResult::success(Value value) {
     reset();
     this->value = value;
-    this->error = new Error(Position(), Position(), "", "");
     return this;
 }
 
 RuntimeResult* RuntimeResult::failure(Error* error) {
     reset();
     this->error = error;
-    if (error->pos_start.file_name.empty()) {
-        error->pos_start.file_name = error->pos_start.file_name;
-    }
     return this;
 }
 
-RuntimeResult* RuntimeResult::success_return(Value* value) {
+RuntimeResult* RuntimeResult::success_return(Value value) {
     reset();
     this->func_return_value = value;
+    this->func_should_return = true;
+    return this;
+}
+
+RuntimeResult* RuntimeResult::success_tail_call() {
+    reset();
+    this->func_should_tail_call = true;
     return this;
 }
 
@@ -2208,179 +4375,290 @@ RuntimeResult* RuntimeResult::success_break() {
 
 // ************VALUE CLASS************
 
-Value::Value() {
-    set_pos();
-    set_context();
+Value::Value() : kind(NUMBER_VALUE), type(INTEGER), int_value(0) {}
+
+Value::Value(int64_t value) : kind(NUMBER_VALUE), type(INTEGER), int_value(value) {}
+
+Value::Value(double value) : kind(NUMBER_VALUE), type(FLOAT), float_value(value) {}
+
+Value::Value(Object* object) : kind(object->kind), type(INTEGER), object(object) {}
+
+Value Value::unbound() {
+    Value value;
+    value.type = UNBOUND;
+    return value;
 }
 
-void Value::set_pos(Position pos_start, Position pos_end) {
-    this->pos_start = pos_start;
-    this->pos_end = pos_end;
+bool Value::is_callable() const {
+    return kind == FUNCTION_VALUE || kind == BUILTIN_FUNCTION_VALUE;
 }
 
-Value* Value::set_context(Context context) {
-    this->context = context;
-    return this;
+std::string Value::repr() const {
+    switch (kind) {
+        case NUMBER_VALUE:
+            if (type == INTEGER) {
+                return std::to_string(int_value);
+            } else {
+                return std::to_string(float_value);
+            }
+        case LIST_VALUE: return as<List>()->repr();
+        case FUNCTION_VALUE: return as<Function>()->repr();
+        case STRING_VALUE: return as<String>()->repr();
+        default: return "";
+    }
 }
 
-std::string Value::repr() {
-    if (auto val = dynamic_cast<Number*>(this)) {
-        return val->repr();
-    } else if (auto val = dynamic_cast<List*>(this)) {
-        return val->repr();
-    } else if (auto val = dynamic_cast<Function*>(this)) {
-        return val->repr();
-    } else if (auto val = dynamic_cast<String*>(this)) {
-        return val->repr();
+Value Value::copy() const {
+    // functions are never modified once made, so they can be shared
+    if (kind == NUMBER_VALUE || kind == FUNCTION_VALUE || kind == BUILTIN_FUNCTION_VALUE) {
+        return *this;
     }
+    return Value(object->copy());
+}
+
+bool Value::is_true() const {
+    if (kind != NUMBER_VALUE) {
+        return object->is_true();
+    }
+    if (type == INTEGER) {
+        return int_value != 0;
+    } else {
+        return float_value != 0;
+    }
+}
 
-    return "";
+// Raised without a position, the interpreter places it at the failing expression
+RuntimeError* illegal_operation() {
+    return new RuntimeError(Position(), Position(), "Illegal operation", current_context);
 }
 
-std::pair<Value*, Error*> Value::added_to(Value* other) {
-    return std::pair(new Number(), illegal_operation(other));
+// ************OBJECTS************
+
+Object::Object(ValueKind kind) : kind(kind) {
+    heap.add(this);
 }
 
-std::pair<Value*, Error*> Value::subtracted_by(Value* other) {
-    return std::pair(new Number(), illegal_operation(other));
+void* Object::operator new(size_t size) {
+    heap.bytes_allocated += size;
+    return ::operator new(size);
 }
 
-std::pair<Value*, Error*> Value::multiplied_by(Value* other) {
-    return std::pair(new Number(), illegal_operation(other));
+void Object::operator delete(void* object, size_t size) {
+    heap.bytes_allocated -= size;
+    ::operator delete(object);
 }
 
-std::pair<Value*, Error*> Value::divided_by(Value* other) {
-    return std::pair(new Number(), illegal_operation(other));
+std::pair<Value, Error*> Object::added_to(Value other) {
+    return std::pair(Value(), illegal_operation());
 }
 
-std::pair<Value*, Error*> Value::raised_to(Value* other) {
-    return std::pair(new Number(), illegal_operation(other));
+std::pair<Value, Error*> Object::subtracted_by(Value other) {
+    return std::pair(Value(), illegal_operation());
 }
 
-std::pair<Value*, Error*> Value::get_comparison_eq(Value* other) {
-    return std::pair(new Number(), illegal_operation(other));
+std::pair<Value, Error*> Object::multiplied_by(Value other) {
+    return std::pair(Value(), illegal_operation());
 }
 
-std::pair<Value*, Error*> Value::get_comparison_ne(Value* other) {
-    return std::pair(new Number(), illegal_operation(other));
+std::pair<Value, Error*> Object::divided_by(Value other) {
+    return std::pair(Value(), illegal_operation());
 }
 
-std::pair<Value*, Error*> Value::get_comparison_lt(Value* other) {
-    return std::pair(new Number(), illegal_operation(other));
+std::pair<Value, Error*> Object::raised_to(Value other) {
+    return std::pair(Value(), illegal_operation());
 }
 
-std::pair<Value*, Error*> Value::get_comparison_gt(Value* other) {
-    return std::pair(new Number(), illegal_operation(other));
+std::pair<Value, Error*> Object::get_comparison_eq(Value other) {
+    return std::pair(Value(), illegal_operation());
 }
 
-std::pair<Value*, Error*> Value::get_comparison_lte(Value* other) {
-    return std::pair(new Number(), illegal_operation(other));
+std::pair<Value, Error*> Object::get_comparison_ne(Value other) {
+    return std::pair(Value(), illegal_operation());
 }
 
-std::pair<Value*, Error*> Value::get_comparison_gte(Value* other) {
-    return std::pair(new Number(), illegal_operation(other));
+std::pair<Value, Error*> Object::get_comparison_lt(Value other) {
+    return std::pair(Value(), illegal_operation());
 }
 
-std::pair<Value*, Error*> Value::anded_with(Value* other) {
-    return std::pair(new Number(), illegal_operation(other));
+std::pair<Value, Error*> Object::get_comparison_gt(Value other) {
+    return std::pair(Value(), illegal_operation());
 }
 
-std::pair<Value*, Error*> Value::ored_with(Value* other) {
-    return std::pair(new Number(), illegal_operation(other));
+std::pair<Value, Error*> Object::get_comparison_lte(Value other) {
+    return std::pair(Value(), illegal_operation());
 }
 
-std::pair<Value*, Error*> Value::notted() {
-    return std::pair(new Number(), illegal_operation());
+std::pair<Value, Error*> Object::get_comparison_gte(Value other) {
+    return std::pair(Value(), illegal_operation());
 }
 
-RuntimeError* Value::illegal_operation(Value* other) {
-    if (other==nullptr) {
-        return new RuntimeError(pos_start, pos_end, "Illegal operation", context);
-    }
-    return new RuntimeError(pos_start, other->pos_end, "Illegal operation", context);
+std::pair<Value, Error*> Object::anded_with(Value other) {
+    return std::pair(Value(), illegal_operation());
+}
+
+std::pair<Value, Error*> Object::ored_with(Value other) {
+    return std::pair(Value(), illegal_operation());
 }
 
-std::pair<RuntimeResult*, Error*> Value::execute(std::vector<Value*> args) {
-    return std::pair(new RuntimeResult(), illegal_operation());
+std::pair<Value, Error*> Object::notted() {
+    return std::pair(Value(), illegal_operation());
 }
 
-Value* Value::copy() {
-    throw std::runtime_error("No copy method defined");
+RuntimeResult Object::execute(Arguments args, const CallSite& call) {
+    RuntimeResult rt_result;
+    return *rt_result.failure(illegal_operation());
 }
 
-bool Value::is_true() {
+bool Object::is_true() {
     return false;
 }
 
+// ************GARBAGE COLLECTOR************
+
+Heap heap;
+
+void Heap::add(Object* object) {
+    object->next_object = objects;
+    objects = object;
+    object_count++;
+}
+
+bool Heap::should_collect() const {
+    return bytes_allocated >= next_collection;
+}
+
+void Heap::mark(Value value, std::vector<Object*>& worklist) {
+    if (value.kind != NUMBER_VALUE && !value.object->marked) {
+        value.object->marked = true;
+        worklist.push_back(value.object);
+    }
+}
+
+void Heap::collect() {
+    auto start = std::chrono::steady_clock::now();
+
+    // Mark everything reachable from the roots
+    std::vector<Object*> worklist;
+    for (const Value& value : global_symbol_table.values) {
+        mark(value, worklist);
+    }
+    for (size_t i = 0; i <= frames.top && i < frames.blocks.size(); i++) {
+        for (size_t slot = 0; slot < frames.blocks[i].used; slot++) {
+            mark(frames.blocks[i].values[slot], worklist);
+        }
+    }
+    for (size_t i = 0; i < active_stacks; i++) {
+        for (const Value& value : stacks[i]) {
+            mark(value, worklist);
+        }
+    }
+    for (Chunk* chunk : chunks) {
+        for (const Value& value : chunk->constants) {
+            mark(value, worklist);
+        }
+    }
+    for (const Value& value : roots) {
+        mark(value, worklist);
+    }
+    while (!worklist.empty()) {
+        Object* object = worklist.back();
+        worklist.pop_back();
+        if (object->kind == LIST_VALUE) {
+            for (const Value& element : static_cast<List*>(object)->elements) {
+                mark(element, worklist);
+            }
+        }
+    }
+
+    // Sweep whatever was not marked
+    Object** link = &objects;
+    while (*link != nullptr) {
+        Object* object = *link;
+        if (object->marked) {
+            object->marked = false;
+            link = &object->next_object;
+        } else {
+            *link = object->next_object;
+            object_count--;
+            delete object;
+        }
+    }
+
+    // Let the heap grow to twice its live size before collecting again
+    next_collection = std::max(bytes_allocated * 2, (size_t) 1 << 20);
+    collections++;
+    double pause_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    total_pause_ms += pause_ms;
+    max_pause_ms = std::max(max_pause_ms, pause_ms);
+}
+
+RootScope::RootScope() : base(heap.roots.size()) {}
+
+RootScope::~RootScope() {
+    heap.roots.resize(base);
+}
+
+void RootScope::push(Value value) {
+    heap.roots.push_back(value);
+}
+
+std::vector<Value> RootScope::values() const {
+    return std::vector<Value>(heap.roots.begin() + base, heap.roots.end());
+}
+
 // ************STRINGS************
 
-String::String(std::string value) : value(value) {
-    set_pos();
-    set_context();
+String::String(std::string value) : Object(STRING_VALUE), value(value) {
 }
 
-String::String() : value("") {}
+String::String() : Object(STRING_VALUE), value("") {}
 
 String* String::copy() {
-    String* copy = new String(value);
-    copy->set_pos(pos_start, pos_end);
-    copy->set_context(context);
-    return copy;
+    return new String(value);
 }
 
 bool String::is_true() {
     return value != "";
 }
 
-std::pair<Value*, Error*> String::added_to(Value* other) {
-    if (auto str = dynamic_cast<String*>(other)) {
-        return std::pair(new String(value + str->value), new Error(Position(), Position(), "", ""));
+std::pair<Value, Error*> String::added_to(Value other) {
+    if (other.kind == STRING_VALUE) {
+        return std::pair(Value(new String(value + other.as<String>()->value)), nullptr);
     }
-    return std::pair(new String(), illegal_operation(other));
+    return std::pair(Value(new String()), illegal_operation());
 }
 
-std::pair<Value*, Error*> String::multiplied_by(Value* other) {
-    if (auto num = dynamic_cast<Number*>(other)) {
+std::pair<Value, Error*> String::multiplied_by(Value other) {
+    if (other.kind == NUMBER_VALUE) {
         std::string new_value = "";
-        for (int i = 0; i < num->getAsInt(); i++) {
+        for (int i = 0; i < other.getAsInt(); i++) {
             new_value += value;
         }
-        return std::pair(new String(new_value), new Error(Position(), Position(), "", ""));
+        return std::pair(Value(new String(new_value)), nullptr);
     }
-    return std::pair(new String(), illegal_operation(other));
+    return std::pair(Value(new String()), illegal_operation());
 }
 
-std::pair<Value*, Error*> String::get_comparison_eq(Value* other) {
-    if (auto str = dynamic_cast<String*>(other)) {
-        return std::pair(new Number(static_cast<int64_t>(value == str->value)), new Error(Position(), Position(), "", ""));
+std::pair<Value, Error*> String::get_comparison_eq(Value other) {
+    if (other.kind == STRING_VALUE) {
+        return std::pair(Value(static_cast<int64_t>(value == other.as<String>()->value)), nullptr);
     }
-    return std::pair(new Number(), illegal_operation(other));
+    return std::pair(Value(), illegal_operation());
 }
 
-std::pair<Value*, Error*> String::get_comparison_ne(Value* other) {
-    if (auto str = dynamic_cast<String*>(other)) {
-        return std::pair(new Number(static_cast<int64_t>(value != str->value)), new Error(Position(), Position(), "", ""));
+std::pair<Value, Error*> String::get_comparison_ne(Value other) {
+    if (other.kind == STRING_VALUE) {
+        return std::pair(Value(static_cast<int64_t>(value != other.as<String>()->value)), nullptr);
     }
-    return std::pair(new Number(), illegal_operation(other));
+    return std::pair(Value(), illegal_operation());
 }
 
 // ************NUMBERS************
 
-Number::Number() : type(INTEGER), int_value(0), is_null(true), pos_start(Position()), pos_end(Position()) {}
-
-Number::Number(int64_t value) {
-    this->type = INTEGER;
-    this->int_value = value;
-    this->is_null = false;
-}
-
-Number::Number(double value) {
-    this->type = FLOAT;
-    this->float_value = value;
-    this->is_null = false;
-}
+// Operators on numbers are computed inline; any other left operand forwards
+// to its Object, and a number can only be combined with another number.
 
-double Number::getAsFloat() const {
+double Value::getAsFloat() const {
     if (type == INTEGER) {
         return static_cast<double>(int_value);
     } else {
@@ -2388,7 +4666,7 @@ double Number::getAsFloat() const {
     }
 }
 
-int64_t Number::getAsInt() const {
+int64_t Value::getAsInt() const {
     if (type == INTEGER) {
         return int_value;
     } else {
@@ -2396,617 +4674,589 @@ int64_t Number::getAsInt() const {
     }
 }
 
-// fallback functions for when the argument is not a Number
-
-Error* Number::added_to(void* other) {
-    return illegal_operation(static_cast<Number*>(other));
-}
-Error* Number::subtracted_by(void* other) {
-    return illegal_operation(static_cast<Number*>(other));
-}
-Error* Number::multiplied_by(void* other) {
-    return illegal_operation(static_cast<Number*>(other));
-}
-Error* Number::divided_by(void* other) {
-    return illegal_operation(static_cast<Number*>(other));
-}
-Error* Number::raised_to(void* other) {
-    return illegal_operation(static_cast<Number*>(other));
-}
-Error* Number::get_comparison_eq(void* other) {
-    return illegal_operation(static_cast<Number*>(other));
-}
-Error* Number::get_comparison_ne(void* other) {
-    return illegal_operation(static_cast<Number*>(other));
-}
-Error* Number::get_comparison_lt(void* other) {
-    return illegal_operation(static_cast<Number*>(other));
-}
-Error* Number::get_comparison_gt(void* other) {
-    return illegal_operation(static_cast<Number*>(other));
-}
-Error* Number::get_comparison_lte(void* other) {
-    return illegal_operation(static_cast<Number*>(other));
-}
-Error* Number::get_comparison_gte(void* other) {
-    return illegal_operation(static_cast<Number*>(other));
-}
-Error* Number::anded_with(void* other) {
-    return illegal_operation(static_cast<Number*>(other));
-}
-Error* Number::ored_with(void* other) {
-    return illegal_operation(static_cast<Number*>(other));
-}
-
-std::pair<Value*, Error*> Number::added_to(Value* other) {
-    Number* other_num = static_cast<Number*>(other);  
-    Number* num;
-    if (type==INTEGER && other_num->type==INTEGER) {
-        num = new Number(int_value + other_num->int_value);
-    } else {
-        num = new Number(getAsFloat() + other_num->getAsFloat());
+std::pair<Value, Error*> Value::added_to(Value other) const {
+    if (kind != NUMBER_VALUE) {
+        return object->added_to(other);
+    }
+    if (other.kind != NUMBER_VALUE) {
+        return std::pair(Value(), illegal_operation());
     }
-    num->set_context(context);
-    return std::pair(num, new Error(Position(), Position(), "", ""));
+    if (type==INTEGER && other.type==INTEGER) {
+        return std::pair(Value(int_value + other.int_value), nullptr);
+    }
+    return std::pair(Value(getAsFloat() + other.getAsFloat()), nullptr);
 }
 
-std::pair<Value*, Error*> Number::subtracted_by(Value* other) {
-    Number* other_num = static_cast<Number*>(other);  
-    Number* num;
-    if (type==INTEGER && other_num->type==INTEGER) {
-        num = new Number(int_value - other_num->int_value);
-    } else {
-        num = new Number(getAsFloat() - other_num->getAsFloat());
+std::pair<Value, Error*> Value::subtracted_by(Value other) const {
+    if (kind != NUMBER_VALUE) {
+        return object->subtracted_by(other);
     }
-    num->set_context(context);
-    return std::pair(num, new Error(Position(), Position(), "", ""));
+    if (other.kind != NUMBER_VALUE) {
+        return std::pair(Value(), illegal_operation());
+    }
+    if (type==INTEGER && other.type==INTEGER) {
+        return std::pair(Value(int_value - other.int_value), nullptr);
+    }
+    return std::pair(Value(getAsFloat() - other.getAsFloat()), nullptr);
 }
 
-std::pair<Value*, Error*> Number::multiplied_by(Value* other) {
-    Number* other_num = static_cast<Number*>(other);  
-    Number* num;
-    if (type==INTEGER && other_num->type==INTEGER) {
-        num = new Number(int_value * other_num->int_value);
-    } else {
-        num = new Number(getAsFloat() * other_num->getAsFloat());
+std::pair<Value, Error*> Value::multiplied_by(Value other) const {
+    if (kind != NUMBER_VALUE) {
+        return object->multiplied_by(other);
+    }
+    if (other.kind != NUMBER_VALUE) {
+        return std::pair(Value(), illegal_operation());
     }
-    num->set_context(context);
-    return std::pair(num, new Error(Position(), Position(), "", ""));
+    if (type==INTEGER && other.type==INTEGER) {
+        return std::pair(Value(int_value * other.int_value), nullptr);
+    }
+    return std::pair(Value(getAsFloat() * other.getAsFloat()), nullptr);
 }
 
-std::pair<Value*, Error*> Number::divided_by(Value* other) {
-    Number* other_num = static_cast<Number*>(other);
-    Number* num;
-    if (type==INTEGER && other_num->type==INTEGER) {
-        if (other_num->int_value == 0) {
-            Position error_pos = pos_start;
-            error_pos.file_name = context.parent_entry_pos.file_name;
-            error_pos.file_text = context.parent_entry_pos.file_text;
-            RuntimeError* error = new RuntimeError(error_pos, other->pos_end, "Division by zero", context);
-            return std::pair(new Number(), error);
-        }
-        num = new Number(int_value / other_num->int_value);
-    } else {
-        if (other_num->getAsFloat() == 0) {
-            Position error_pos = pos_start;
-            error_pos.file_name = context.parent_entry_pos.file_name;
-            error_pos.file_text = context.parent_entry_pos.file_text;
-            RuntimeError* error = new RuntimeError(error_pos, other->pos_end, "Division by zero", context);
-            return std::pair(new Number(), error);
+std::pair<Value, Error*> Value::divided_by(Value other) const {
+    if (kind != NUMBER_VALUE) {
+        return object->divided_by(other);
+    }
+    if (other.kind != NUMBER_VALUE) {
+        return std::pair(Value(), illegal_operation());
+    }
+    if (type==INTEGER && other.type==INTEGER) {
+        if (other.int_value == 0) {
+            Position error_pos = Position(0, current_context->parent_entry_pos.file_id);
+            RuntimeError* error = new RuntimeError(error_pos, Position(), "Division by zero", current_context);
+            return std::pair(Value(), error);
         }
-        num = new Number(getAsFloat() / other_num->getAsFloat());
+        return std::pair(Value(int_value / other.int_value), nullptr);
     }
-    num->set_context(context);
-    return std::pair(num, new Error(Position(), Position(), "", ""));
-}
-
-std::pair<Value*, Error*> Number::raised_to(Value* other) {
-    Number* other_num = static_cast<Number*>(other);
-    Number* num;
-    if (type==INTEGER && other_num->type==INTEGER) {
-        num = new Number(std::pow(int_value, other_num->int_value));
-    } else {
-        num = new Number(std::pow(getAsFloat(), other_num->getAsFloat()));
+    if (other.getAsFloat() == 0) {
+        Position error_pos = Position(0, current_context->parent_entry_pos.file_id);
+        RuntimeError* error = new RuntimeError(error_pos, Position(), "Division by zero", current_context);
+        return std::pair(Value(), error);
     }
-    num->set_context(context);
-    return std::pair(num, new Error(Position(), Position(), "", ""));
+    return std::pair(Value(getAsFloat() / other.getAsFloat()), nullptr);
 }
 
-std::pair<Value*, Error*> Number::get_comparison_eq(Value* other) {
-    Number* other_num = static_cast<Number*>(other);  
-    Number* num = new Number(static_cast<int64_t>(getAsFloat() == other_num->getAsFloat()));
-    num->set_context(context);
-    return std::pair(num, new Error(Position(), Position(), "", ""));
-}
-
-std::pair<Value*, Error*> Number::get_comparison_ne(Value* other) {
-    Number* other_num = static_cast<Number*>(other);  
-    Number* num = new Number(static_cast<int64_t>(getAsFloat() != other_num->getAsFloat()));
-    num->set_context(context);
-    return std::pair(num, new Error(Position(), Position(), "", ""));
+std::pair<Value, Error*> Value::raised_to(Value other) const {
+    if (kind != NUMBER_VALUE) {
+        return object->raised_to(other);
+    }
+    if (other.kind != NUMBER_VALUE) {
+        return std::pair(Value(), illegal_operation());
+    }
+    if (type==INTEGER && other.type==INTEGER) {
+        return std::pair(Value(std::pow(int_value, other.int_value)), nullptr);
+    }
+    return std::pair(Value(std::pow(getAsFloat(), other.getAsFloat())), nullptr);
 }
 
-std::pair<Value*, Error*> Number::get_comparison_lt(Value* other) {
-    Number* other_num = static_cast<Number*>(other);  
-    Number* num = new Number(static_cast<int64_t>(getAsFloat() < other_num->getAsFloat()));
-    num->set_context(context);
-    return std::pair(num, new Error(Position(), Position(), "", ""));
+std::pair<Value, Error*> Value::get_comparison_eq(Value other) const {
+    if (kind != NUMBER_VALUE) {
+        return object->get_comparison_eq(other);
+    }
+    if (other.kind != NUMBER_VALUE) {
+        return std::pair(Value(), illegal_operation());
+    }
+    return std::pair(Value(static_cast<int64_t>(getAsFloat() == other.getAsFloat())), nullptr);
 }
 
-std::pair<Value*, Error*> Number::get_comparison_gt(Value* other) {
-    Number* other_num = static_cast<Number*>(other);  
-    Number* num = new Number(static_cast<int64_t>(getAsFloat() > other_num->getAsFloat()));
-    num->set_context(context);
-    return std::pair(num, new Error(Position(), Position(), "", ""));
+std::pair<Value, Error*> Value::get_comparison_ne(Value other) const {
+    if (kind != NUMBER_VALUE) {
+        return object->get_comparison_ne(other);
+    }
+    if (other.kind != NUMBER_VALUE) {
+        return std::pair(Value(), illegal_operation());
+    }
+    return std::pair(Value(static_cast<int64_t>(getAsFloat() != other.getAsFloat())), nullptr);
 }
 
-std::pair<Value*, Error*> Number::get_comparison_lte(Value* other) {
-    Number* other_num = static_cast<Number*>(other);  
-    Number* num = new Number(static_cast<int64_t>(getAsFloat() <= other_num->getAsFloat()));
-    num->set_context(context);
-    return std::pair(num, new Error(Position(), Position(), "", ""));
+std::pair<Value, Error*> Value::get_comparison_lt(Value other) const {
+    if (kind != NUMBER_VALUE) {
+        return object->get_comparison_lt(other);
+    }
+    if (other.kind != NUMBER_VALUE) {
+        return std::pair(Value(), illegal_operation());
+    }
+    return std::pair(Value(static_cast<int64_t>(getAsFloat() < other.getAsFloat())), nullptr);
 }
 
-std::pair<Value*, Error*> Number::get_comparison_gte(Value* other) {
-    Number* other_num = static_cast<Number*>(other);  
-    Number* num = new Number(static_cast<int64_t>(getAsFloat() >= other_num->getAsFloat()));
-    num->set_context(context);
-    return std::pair(num, new Error(Position(), Position(), "", ""));
+std::pair<Value, Error*> Value::get_comparison_gt(Value other) const {
+    if (kind != NUMBER_VALUE) {
+        return object->get_comparison_gt(other);
+    }
+    if (other.kind != NUMBER_VALUE) {
+        return std::pair(Value(), illegal_operation());
+    }
+    return std::pair(Value(static_cast<int64_t>(getAsFloat() > other.getAsFloat())), nullptr);
 }
 
-std::pair<Value*, Error*> Number::anded_with(Value* other) {
-    Number* other_num = static_cast<Number*>(other);  
-    Number* num = new Number(static_cast<int64_t>(getAsFloat() && other_num->getAsFloat()));
-    num->set_context(context);
-    return std::pair(num, new Error(Position(), Position(), "", ""));
+std::pair<Value, Error*> Value::get_comparison_lte(Value other) const {
+    if (kind != NUMBER_VALUE) {
+        return object->get_comparison_lte(other);
+    }
+    if (other.kind != NUMBER_VALUE) {
+        return std::pair(Value(), illegal_operation());
+    }
+    return std::pair(Value(static_cast<int64_t>(getAsFloat() <= other.getAsFloat())), nullptr);
 }
 
-std::pair<Value*, Error*> Number::ored_with(Value* other) {
-    Number* other_num = static_cast<Number*>(other);  
-    Number* num = new Number(static_cast<int64_t>(getAsFloat() || other_num->getAsFloat()));
-    num->set_context(context);
-    return std::pair(num, new Error(Position(), Position(), "", ""));
+std::pair<Value, Error*> Value::get_comparison_gte(Value other) const {
+    if (kind != NUMBER_VALUE) {
+        return object->get_comparison_gte(other);
+    }
+    if (other.kind != NUMBER_VALUE) {
+        return std::pair(Value(), illegal_operation());
+    }
+    return std::pair(Value(static_cast<int64_t>(getAsFloat() >= other.getAsFloat())), nullptr);
 }
 
-std::pair<Value*, Error*> Number::notted() {
-    Number* num = new Number(static_cast<int64_t>(!getAsFloat()));
-    num->set_context(context);
-    return std::pair(num, new Error(Position(), Position(), "", ""));
+std::pair<Value, Error*> Value::anded_with(Value other) const {
+    if (kind != NUMBER_VALUE) {
+        return object->anded_with(other);
+    }
+    if (other.kind != NUMBER_VALUE) {
+        return std::pair(Value(), illegal_operation());
+    }
+    return std::pair(Value(static_cast<int64_t>(getAsFloat() && other.getAsFloat())), nullptr);
 }
 
-Number* Number::copy() {
-    Number* num;
-    if (type == INTEGER) {
-        num = new Number(int_value);
-    } else {
-        num = new Number(float_value);
+std::pair<Value, Error*> Value::ored_with(Value other) const {
+    if (kind != NUMBER_VALUE) {
+        return object->ored_with(other);
+    }
+    if (other.kind != NUMBER_VALUE) {
+        return std::pair(Value(), illegal_operation());
     }
-    num->set_context(context);
-    num->set_pos(pos_start, pos_end);
-    return num;
+    return std::pair(Value(static_cast<int64_t>(getAsFloat() || other.getAsFloat())), nullptr);
 }
 
-bool Number::is_true() {
-    if (type == INTEGER) {
-        return int_value != 0;
-    } else {
-        return float_value != 0;
+std::pair<Value, Error*> Value::notted() const {
+    if (kind != NUMBER_VALUE) {
+        return object->notted();
     }
+    return std::pair(Value(static_cast<int64_t>(!getAsFloat())), nullptr);
 }
 
 // ************FUNCTIONS************
 
-BaseFunction::BaseFunction(Token n) {
-    set_pos();
-    set_context();
-    this->name = n.value.empty() ? "<anonymous>" : n.value;
-}
+BaseFunction::BaseFunction(ValueKind kind) : Object(kind) {}
 
-void BaseFunction::generate_new_context(Context& new_context) {
-    new_context = Context(name, &context, pos_start);
-    new_context.parent_entry_pos = pos_start;
-    new_context.parent_entry_pos.file_name = context.parent_entry_pos.file_name;
-    new_context.parent_entry_pos.file_text = context.parent_entry_pos.file_text;
-    new_context.symbol_table = SymbolTable(&context.symbol_table);
+// The caller's context is the current one, so calls chain onto it
+void BaseFunction::generate_new_context(Context& new_context, const CallSite& call) {
+    new_context = Context(call.display_name, current_context, call.pos_start);
+    new_context.parent_entry_pos = Position(call.pos_start.index, current_context->parent_entry_pos.file_id);
 }
 
-RuntimeResult* BaseFunction::check_args(std::vector<Value*> args, std::vector<Token> arg_name_tokens) {
-    RuntimeResult rt_result = RuntimeResult();
-    if (args.size() != arg_name_tokens.size()) {
-        return rt_result.failure(new RuntimeError(pos_start, pos_end, "Expected " + std::to_string(arg_name_tokens.size()) + " arguments, but got " + std::to_string(args.size()), context));
+Error* BaseFunction::check_args(Arguments args, size_t arity, const CallSite& call) {
+    if (args.size() != arity) {
+        return new RuntimeError(call.pos_start, call.pos_end, "Expected " + std::to_string(arity) + " arguments, but got " + std::to_string(args.size()), current_context);
     }
-    return rt_result.success(new Number());
+    return nullptr;
 }
 
-void BaseFunction::populate_args(std::vector<Value*> args, std::vector<Token> arg_name_tokens, Context& new_context) {
+// Arguments take the first slots of the frame, in order
+void BaseFunction::populate_args(Arguments args, Context& new_context) {
     for (int i = 0; i < args.size(); i++) {
-        Token arg_name_token = arg_name_tokens[i];
-        Value* arg_value = args[i];
-        arg_value->set_context(new_context);
-        new_context.symbol_table.set(arg_name_token.value, arg_value->copy());
+        new_context.slots[i] = args[i].copy();
     }
 } 
 
-RuntimeResult BaseFunction::check_and_populate_args(std::vector<Value*> args, std::vector<Token> arg_name_tokens, Context& new_context) {
-    RuntimeResult rt_result = RuntimeResult();
-    rt_result.reg(*this->check_args(args, arg_name_tokens));
-    if (rt_result.should_return()) {
-        return rt_result;
-    }
-    this->populate_args(args, arg_name_tokens, new_context);
-    return *rt_result.success(new Number());
-}
-
-Function::Function(Token var_name_token, std::vector<Token> arg_name_tokens, Node* body_node, bool should_auto_return) 
-    : BaseFunction(var_name_token) {
+Function::Function(Token var_name_token, const std::vector<Token>* arg_name_tokens, Node* body_node, bool should_auto_return) 
+    : BaseFunction(FUNCTION_VALUE) {
+        this->var_name_token = var_name_token;
         this->body_node = body_node;
         this->arg_name_tokens = arg_name_tokens;
-        this->name = var_name_token.value;
         this->should_auto_return = should_auto_return;
     };;
 
-std::pair<RuntimeResult*, Error*> Function::execute(std::vector<Value*> args) {
-    RuntimeResult* rt_result = new RuntimeResult();
-    Interpreter interpreter = Interpreter(nullptr);
+Function::~Function() {
+    if (arena != nullptr) {
+        arena->release();
+    }
+}
 
-    Context exec_ctx;
-    generate_new_context(exec_ctx);
+void Function::hold(Arena* arena) {
+    if (arena != nullptr) {
+        arena->retain();
+    }
+    if (this->arena != nullptr) {
+        this->arena->release();
+    }
+    this->arena = arena;
+}
 
-    rt_result->reg(check_and_populate_args(args, arg_name_tokens, exec_ctx));
-    if (rt_result->should_return()) {
-        return std::pair(rt_result, new Error(Position(), Position(), "", ""));
+RuntimeResult Function::execute(Arguments args, const CallSite& call) {
+    RuntimeResult rt_result;
+    Error* error = check_args(args, arg_name_tokens->size(), call);
+    if (error != nullptr) {
+        return *rt_result.failure(error);
     }
 
-    Value* value = rt_result->reg(interpreter.visit(body_node, exec_ctx));
-    if (rt_result->error->err_name != "") {
-        rt_result->error->pos_start = pos_start;
-        return std::pair(rt_result, rt_result->error);
+    Context exec_ctx;
+    generate_new_context(exec_ctx, call);
+    exec_ctx.locals = locals;
+    exec_ctx.slots = frames.push(locals->size());
+    populate_args(args, exec_ctx);
+
+    Value value;
+    Context* caller_context = current_context;
+    current_context = &exec_ctx;
+    if (chunk != nullptr) {
+        VM vm = VM();
+        value = rt_result.reg(vm.run(chunk, exec_ctx));
+    } else {
+        Interpreter interpreter = Interpreter(nullptr);
+        do {
+            value = rt_result.reg(interpreter.visit(body_node, exec_ctx));
+        } while (rt_result.func_should_tail_call);
+    }
+    current_context = caller_context;
+    frames.pop(locals->size());
+    if (rt_result.error != nullptr) {
+        rt_result.error->set_start(call.pos_start);
+        return rt_result;
     }
     
-    if (rt_result->should_return() && rt_result->func_return_value==nullptr) {
-        rt_result->error->pos_start = pos_start;
-        return std::pair(rt_result, new Error(Position(), Position(), "", ""));
+    if (rt_result.should_return() && !rt_result.func_should_return) {
+        return rt_result;
     }
 
-    Value* ret_value;
-    if (rt_result->func_return_value != nullptr) {
-        ret_value = rt_result->func_return_value;
+    Value ret_value;
+    if (rt_result.func_should_return) {
+        ret_value = rt_result.func_return_value;
     } else if (should_auto_return) {
         ret_value = value;
     } else {
-        ret_value = new Number(static_cast<int64_t>(0));
+        ret_value = Value(static_cast<int64_t>(0));
     }
 
-    return std::pair(rt_result->success(ret_value), new Error(Position(), Position(), "", ""));
+    return *rt_result.success(ret_value);
 }
 
 Function* Function::copy() {
     Function* func = new Function(this->var_name_token, this->arg_name_tokens, this->body_node, this->should_auto_return);
-    func->set_context(this->context);
-    func->set_pos(this->pos_start, this->pos_end);
+    func->chunk = this->chunk;
+    func->locals = this->locals;
+    func->hold(this->arena);
     return func;
 }
 
 std::string Function::repr() {
-    return "<function " + name + ">";
+    return "<function " + std::string(var_name_token.value) + ">";
+}
+
+// ************OUTPUT************
+
+OutputBuffer output_buffer = OutputBuffer();
+
+OutputBuffer::~OutputBuffer() {
+    flush();
+}
+
+// Callers write whole lines, so the buffer is only ever flushed at the end of one
+void OutputBuffer::write(std::string_view text) {
+    buffer.append(text);
+    if (buffer.size() >= capacity) {
+        flush();
+    }
+}
+
+void OutputBuffer::flush() {
+    #ifdef __EMSCRIPTEN__
+        if (!buffer.empty()) {
+            // one call for the whole chunk, Module.print adds back the last newline
+            if (buffer.back() == '\n') {
+                buffer.pop_back();
+            }
+            EM_ASM({
+                Module.print(UTF8ToString($0));
+            }, buffer.c_str());
+            buffer.clear();
+        }
+    #else
+        if (!buffer.empty()) {
+            std::cout.write(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+        std::cout.flush();
+    #endif
 }
 
 // ************BUILT-IN FUNCTIONS************
 
-BuiltinFunction::BuiltinFunction(Token name) : BaseFunction(name) {
-    this->name = name.value.empty() ? name.repr() : name.value;
-} 
+BuiltinFunction::BuiltinFunction(std::string_view name, NativeFunction function, int arity) : BaseFunction(BUILTIN_FUNCTION_VALUE) {
+    this->name = name;
+    this->function = function;
+    this->arity = arity;
+}
 
-std::pair<RuntimeResult*, Error*> BuiltinFunction::execute(std::vector<Value*> args) {
-    RuntimeResult* rt_result = new RuntimeResult();
-    Context exec_ctx;
-    generate_new_context(exec_ctx);
-
-    Value* return_value;
-    if (this->name=="print") {
-        return_value = rt_result->reg(*this->func_print(args));
-    } else if (this->name=="input") {
-        return_value = rt_result->reg(*this->func_input(args));
-    } else if (this->name=="input_int") {
-        return_value = rt_result->reg(*this->func_input_int(args));
-    } else if (this->name=="clear") {
-        return_value = rt_result->reg(*this->func_clear(args));
-    } else if (this->name=="is_number") {
-        return_value = rt_result->reg(*this->func_is_number(args));
-    } else if (this->name=="is_string") {
-        return_value = rt_result->reg(*this->func_is_string(args));
-    } else if (this->name=="is_list") {
-        return_value = rt_result->reg(*this->func_is_list(args));
-    } else if (this->name=="is_function") {
-        return_value = rt_result->reg(*this->func_is_function(args));
-    } else if (this->name=="append") {
-        return_value = rt_result->reg(*this->func_append(args));
-    } else if (this->name=="pop") {
-        return_value = rt_result->reg(*this->func_pop(args));
-    } else if (this->name=="extend") {
-        return_value = rt_result->reg(*this->func_extend(args));
-    } else if (this->name=="len") {
-        return_value = rt_result->reg(*this->func_len(args));
-    } else if (this->name=="run") {
-        return_value = rt_result->reg(*this->func_run(args, exec_ctx));
-    } else {
-        return std::pair(rt_result->failure(new RuntimeError(pos_start, pos_end, "No built-in function with name " + this->name, context)), new Error(Position(), Position(), "", ""));
+RuntimeResult BuiltinFunction::execute(Arguments args, const CallSite& call) {
+    RuntimeResult rt_result;
+    if (arity != VARIADIC) {
+        Error* error = check_args(args, arity, call);
+        if (error != nullptr) {
+            return *rt_result.failure(error);
+        }
     }
 
-    if (rt_result->should_return()) {
-        return std::pair(rt_result, new Error(Position(), Position(), "", ""));
+    Context exec_ctx;
+    generate_new_context(exec_ctx, call);
+
+    Value return_value = rt_result.reg(function(args, call, exec_ctx));
+    if (rt_result.should_return()) {
+        return rt_result;
     }
 
-    return std::pair(rt_result->success(return_value), new Error(Position(), Position(), "", ""));
+    return *rt_result.success(return_value);
 }
 
 BuiltinFunction* BuiltinFunction::copy() {
-    BuiltinFunction* func = new BuiltinFunction(this->name);
-    func->set_context(this->context);
-    func->set_pos(this->pos_start, this->pos_end);
-    return func;
+    return new BuiltinFunction(name, function, arity);
 }
 
 std::string BuiltinFunction::repr() {
-    return "<built-in function " + this->name + ">";
+    return "<built-in function " + std::string(this->name) + ">";
 }
 
-RuntimeResult* BuiltinFunction::func_print(std::vector<Value*> args) {
-    RuntimeResult* rt_result = new RuntimeResult();
+RuntimeResult BuiltinFunction::func_print(Arguments args, const CallSite& call, Context& context) {
+    RuntimeResult rt_result;
     std::string output = "";
 
-    for (Value* arg : args) {
-        if (auto arg_str = dynamic_cast<String*>(arg)) {
-            output += arg_str->repr();
-        } else if (auto arg_num = dynamic_cast<Number*>(arg)) {
-            output += arg_num->repr();
-        } else if (auto arg_list = dynamic_cast<List*>(arg)) {
-            output += arg_list->repr();
+    for (Value arg : args) {
+        switch (arg.kind) {
+            case STRING_VALUE:
+            case NUMBER_VALUE:
+            case LIST_VALUE: output += arg.repr(); break;
+            default: break;
         }
     }
-    #ifdef __EMSCRIPTEN__
-        EM_ASM({
-            Module.print(UTF8ToString($0));
-        }, output.c_str());
-    #else
-        std::cout << output << std::endl;
-    #endif
-    return rt_result->success(new Number());
+    output += '\n';
+    output_buffer.write(output);
+    return *rt_result.success(Value());
 }
 
-RuntimeResult* BuiltinFunction::func_input(std::vector<Value*> args) {
-    RuntimeResult* rt_result = new RuntimeResult();
+RuntimeResult BuiltinFunction::func_input(Arguments args, const CallSite& call, Context& context) {
+    RuntimeResult rt_result;
+    output_buffer.flush(); // so that a prompt printed before is seen
     std::string input;
     std::getline(std::cin, input);
-    return rt_result->success(new String(input));
+    return *rt_result.success(Value(new String(input)));
 }
 
-RuntimeResult* BuiltinFunction::func_input_int(std::vector<Value*> args) {
-    RuntimeResult* rt_result = new RuntimeResult();
+RuntimeResult BuiltinFunction::func_input_int(Arguments args, const CallSite& call, Context& context) {
+    RuntimeResult rt_result;
+    output_buffer.flush();
     std::string input;
     std::getline(std::cin, input);
     try {
         int64_t num = std::stoi(input);
-        return rt_result->success(new Number(num));
+        return *rt_result.success(Value(num));
     } catch (std::invalid_argument) {
-        return rt_result->failure(new RuntimeError(Position(), Position(), "Invalid input", context));
+        return *rt_result.failure(new RuntimeError(Position(), Position(), "Invalid input", current_context));
     }
 }
 
-RuntimeResult* BuiltinFunction::func_clear(std::vector<Value*> args) {
-    RuntimeResult* rt_result = new RuntimeResult();
+RuntimeResult BuiltinFunction::func_clear(Arguments args, const CallSite& call, Context& context) {
+    RuntimeResult rt_result;
+    output_buffer.flush(); // clearing must not erase output that was printed before it
     // check os and clear screen
     #ifdef _WIN32
         system("cls");
     #else
         system("clear");
     #endif
-    return rt_result->success(new Number());
+    return *rt_result.success(Value());
 }
 
-RuntimeResult* BuiltinFunction::func_is_number(std::vector<Value*> args) {
-    RuntimeResult* rt_result = new RuntimeResult();
-    if (auto arg = dynamic_cast<Number*>(args[0])) {
-        return rt_result->success(new Number(static_cast<int64_t>(1)));
+RuntimeResult BuiltinFunction::func_is_number(Arguments args, const CallSite& call, Context& context) {
+    RuntimeResult rt_result;
+    if (args[0].kind == NUMBER_VALUE) {
+        return *rt_result.success(Value(static_cast<int64_t>(1)));
     }
-    return rt_result->success(new Number(static_cast<int64_t>(0)));
+    return *rt_result.success(Value(static_cast<int64_t>(0)));
 }
 
-RuntimeResult* BuiltinFunction::func_is_string(std::vector<Value*> args) {
-    RuntimeResult* rt_result = new RuntimeResult();
-    if (auto arg = dynamic_cast<String*>(args[0])) {
-        return rt_result->success(new Number(static_cast<int64_t>(1)));
+RuntimeResult BuiltinFunction::func_is_string(Arguments args, const CallSite& call, Context& context) {
+    RuntimeResult rt_result;
+    if (args[0].kind == STRING_VALUE) {
+        return *rt_result.success(Value(static_cast<int64_t>(1)));
     }
-    return rt_result->success(new Number(static_cast<int64_t>(0)));
+    return *rt_result.success(Value(static_cast<int64_t>(0)));
 }
 
-RuntimeResult* BuiltinFunction::func_is_list(std::vector<Value*> args) {
-    RuntimeResult* rt_result = new RuntimeResult();
-    if (auto arg = dynamic_cast<List*>(args[0])) {
-        return rt_result->success(new Number(static_cast<int64_t>(1)));
+RuntimeResult BuiltinFunction::func_is_list(Arguments args, const CallSite& call, Context& context) {
+    RuntimeResult rt_result;
+    if (args[0].kind == LIST_VALUE) {
+        return *rt_result.success(Value(static_cast<int64_t>(1)));
     }
-    return rt_result->success(new Number(static_cast<int64_t>(0)));
+    return *rt_result.success(Value(static_cast<int64_t>(0)));
 }
 
-RuntimeResult* BuiltinFunction::func_is_function(std::vector<Value*> args) {
-    RuntimeResult* rt_result = new RuntimeResult();
-    if (auto arg = dynamic_cast<Function*>(args[0])) {
-        return rt_result->success(new Number(static_cast<int64_t>(1)));
+RuntimeResult BuiltinFunction::func_is_function(Arguments args, const CallSite& call, Context& context) {
+    RuntimeResult rt_result;
+    if (args[0].kind == FUNCTION_VALUE) {
+        return *rt_result.success(Value(static_cast<int64_t>(1)));
     }
-    return rt_result->success(new Number(static_cast<int64_t>(0)));
+    return *rt_result.success(Value(static_cast<int64_t>(0)));
 }
 
-RuntimeResult* BuiltinFunction::func_append(std::vector<Value*> args) {
-    RuntimeResult* rt_result = new RuntimeResult();
-    if (auto list = dynamic_cast<List*>(args[0])) {
-        Value* value_copy = args[1]->copy();
-        list->elements.push_back(value_copy);
-        return rt_result->success(list);
+RuntimeResult BuiltinFunction::func_append(Arguments args, const CallSite& call, Context& context) {
+    RuntimeResult rt_result;
+    if (args[0].kind == LIST_VALUE) {
+        List* list = args[0].as<List>();
+        list->elements.push_back(args[1].copy());
+        return *rt_result.success(args[0]);
     }
-    return rt_result->failure(new RuntimeError(Position(), Position(), "First argument must be a list", context));
+    return *rt_result.failure(new RuntimeError(Position(), Position(), "First argument must be a list", current_context));
 }
 
-RuntimeResult* BuiltinFunction::func_pop(std::vector<Value*> args) {
-    RuntimeResult* rt_result = new RuntimeResult();
-    if (auto list = dynamic_cast<List*>(args[0])) {
+RuntimeResult BuiltinFunction::func_pop(Arguments args, const CallSite& call, Context& context) {
+    RuntimeResult rt_result;
+    if (args[0].kind == LIST_VALUE) {
+        List* list = args[0].as<List>();
         try {
-            list->elements.erase(list->elements.begin() + static_cast<int>(static_cast<Number*>(args[1])->getAsInt()));
+            list->elements.erase(list->elements.begin() + static_cast<int>(args[1].getAsInt()));
         } catch (std::out_of_range) {
-            return rt_result->failure(new RuntimeError(Position(), Position(), "Index out of range", context));
+            return *rt_result.failure(new RuntimeError(Position(), Position(), "Index out of range", current_context));
         }
-        return rt_result->success(list);
+        return *rt_result.success(args[0]);
     }
-    return rt_result->failure(new RuntimeError(Position(), Position(), "First argument must be a list", context));
+    return *rt_result.failure(new RuntimeError(Position(), Position(), "First argument must be a list", current_context));
 }
 
-RuntimeResult* BuiltinFunction::func_extend(std::vector<Value*> args) {
-    RuntimeResult* rt_result = new RuntimeResult();
-    if (auto list = dynamic_cast<List*>(args[0])) {
-        if (auto other_list = dynamic_cast<List*>(args[1])) {
+RuntimeResult BuiltinFunction::func_extend(Arguments args, const CallSite& call, Context& context) {
+    RuntimeResult rt_result;
+    if (args[0].kind == LIST_VALUE) {
+        List* list = args[0].as<List>();
+        if (args[1].kind == LIST_VALUE) {
+            List* other_list = args[1].as<List>();
             list->elements.insert(list->elements.end(), other_list->elements.begin(), other_list->elements.end());
-            return rt_result->success(list);
+            return *rt_result.success(args[0]);
         }
-        return rt_result->failure(new RuntimeError(Position(), Position(), "Second argument must be a list", context));
+        return *rt_result.failure(new RuntimeError(Position(), Position(), "Second argument must be a list", current_context));
     }
-    return rt_result->failure(new RuntimeError(Position(), Position(), "First argument must be a list", context));
+    return *rt_result.failure(new RuntimeError(Position(), Position(), "First argument must be a list", current_context));
 }
 
-RuntimeResult* BuiltinFunction::func_len(std::vector<Value*> args) {
-    RuntimeResult* rt_result = new RuntimeResult();
-    if (auto list = dynamic_cast<List*>(args[0])) {
-        return rt_result->success(new Number(static_cast<int64_t>(list->elements.size())));
+RuntimeResult BuiltinFunction::func_len(Arguments args, const CallSite& call, Context& context) {
+    RuntimeResult rt_result;
+    if (args[0].kind == LIST_VALUE) {
+        return *rt_result.success(Value(static_cast<int64_t>(args[0].as<List>()->elements.size())));
     }
-    return rt_result->failure(new RuntimeError(Position(), Position(), "Argument must be a list", context));
+    return *rt_result.failure(new RuntimeError(Position(), Position(), "Argument must be a list", current_context));
 }
 
-RuntimeResult* BuiltinFunction::func_run(std::vector<Value*> args, Context& context) {
-    RuntimeResult* rt_result = new RuntimeResult();
-
-    // check if args is empty 
-    if (args.empty()) {
-        return rt_result->failure(new RuntimeError(pos_start, pos_end, "run() requires a filename argument", context));
-    }
+RuntimeResult BuiltinFunction::func_run(Arguments args, const CallSite& call, Context& context) {
+    RuntimeResult rt_result;
 
     // check if filename is a string
-    if (auto file_name = dynamic_cast<String*>(args[0])) {
-        std::string file_value = file_name->value;
-        std::string script;
+    if (args[0].kind == STRING_VALUE) {
+        std::string file_value = args[0].as<String>()->value;
 
-        std::ifstream file(file_value);
-        if (!file.is_open()) {
-            return rt_result->failure(new RuntimeError(pos_start, pos_end, "File: '" + file_value + "' not found", context));
+        std::pair<Script*, Error*> script = script_cache.load(file_value);
+        if (script.first == nullptr && script.second == nullptr) {
+            return *rt_result.failure(new RuntimeError(call.pos_start, call.pos_end, "File: '" + file_value + "' not found", &context));
         }
 
-        try {
-            script = std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-        } catch (const std::exception& e) {
-            return rt_result->failure(new RuntimeError(pos_start, pos_end, "File: '" + file_value + "' not found\n" + std::string(e.what()), context));
+        Error* error = script.second;
+        if (error == nullptr) {
+            error = ::execute(*script.first).second;
         }
 
-        file.close();
-        
-        std::pair<Value*, Error*> out = run(file_value, script);
-        Value* _ = out.first;
-        Error* error = out.second;
-
-        if (error->err_name != "") {
-            return rt_result->failure(new RuntimeError(Position(), Position(), "Error while executing script: '" + file_value + "'\n" + error->as_string(), context));
+        if (error != nullptr) {
+            return *rt_result.failure(new RuntimeError(Position(), Position(), "Error while executing script: '" + file_value + "'\n" + error->as_string(), &context));
         }
 
-        return rt_result->success(new Number(static_cast<int64_t>(0)));
+        return *rt_result.success(Value(static_cast<int64_t>(0)));
     } 
-    return rt_result->failure(new RuntimeError(this->pos_start, this->pos_end, "Filename must be a string", context));
+    return *rt_result.failure(new RuntimeError(call.pos_start, call.pos_end, "Filename must be a string", &context));
 }
 
-// ************LISTS************
+RuntimeResult BuiltinFunction::func_gc_stats(Arguments args, const CallSite& call, Context& context) {
+    RuntimeResult rt_result;
+    std::ostringstream stats;
+    stats << std::fixed << std::setprecision(3);
+    stats << "objects: " << heap.object_count << ", bytes: " << heap.bytes_allocated;
+    stats << ", collections: " << heap.collections;
+    stats << ", pause total: " << heap.total_pause_ms << " ms, pause max: " << heap.max_pause_ms << " ms";
+    stats << ", ast bytes: " << Arena::live_bytes << ", ast high water: " << Arena::high_water;
+    return *rt_result.success(Value(new String(stats.str())));
+}
 
-List::List() {
-    set_pos();
-    set_context();
+RuntimeResult BuiltinFunction::func_flush(Arguments args, const CallSite& call, Context& context) {
+    RuntimeResult rt_result;
+    output_buffer.flush();
+    return *rt_result.success(Value());
 }
 
-List::List(std::vector<Value*> elements) {
-    this->elements = elements;
-    set_pos();
-    set_context();
+// ************LISTS************
+
+List::List() : Object(LIST_VALUE) {
 }
 
-List::~List() {
-    for (Value* element : elements) {
-        delete element;
-    }
+List::List(std::vector<Value> elements) : Object(LIST_VALUE) {
+    this->elements = elements;
 }
 
-std::pair<Value*, Error*> List::added_to(Value* other) {
+std::pair<Value, Error*> List::added_to(Value other) {
     List* new_list = copy();
-    if (auto other_list = dynamic_cast<List*>(other)) {
+    if (other.kind == LIST_VALUE) {
+        List* other_list = other.as<List>();
         new_list->elements.insert(new_list->elements.end(), other_list->elements.begin(), other_list->elements.end());
     } else {
-        return std::pair(new List(), illegal_operation(other));
+        return std::pair(Value(new List()), illegal_operation());
     }
-    return std::pair(new_list, new Error(Position(), Position(), "", ""));
+    return std::pair(Value(new_list), nullptr);
 }
 
-std::pair<Value*, Error*> List::multiplied_by(Value* other) {
+std::pair<Value, Error*> List::multiplied_by(Value other) {
     List* new_list = copy();
-    if (auto other_num = dynamic_cast<Number*>(other)) {
-        for (int i = 0; i < other_num->getAsInt(); i++) {
+    if (other.kind == NUMBER_VALUE) {
+        for (int i = 0; i < other.getAsInt(); i++) {
             new_list->elements.insert(new_list->elements.end(), elements.begin(), elements.end());
         }
     } else {
-        return std::pair(new List(), illegal_operation(other));
+        return std::pair(Value(new List()), illegal_operation());
     }
-    return std::pair(new_list, new Error(Position(), Position(), "", ""));
+    return std::pair(Value(new_list), nullptr);
 }
 
-std::pair<Value*, Error*> List::subtracted_by(Value* other) {
+std::pair<Value, Error*> List::subtracted_by(Value other) {
     List* new_list = copy();
-    if (auto index = dynamic_cast<Number*>(other)) {
+    if (other.kind == NUMBER_VALUE) {
         try {
-            new_list->elements.erase(new_list->elements.begin() + index->getAsInt());
+            new_list->elements.erase(new_list->elements.begin() + other.getAsInt());
         } catch (std::out_of_range) {
-            return std::pair(new List(), new RuntimeError(Position(), Position(), "Index out of range", context));
+            return std::pair(Value(new List()), new RuntimeError(Position(), Position(), "Index out of range", current_context));
         }
     } else {
-        return std::pair(new List(), illegal_operation(other));
+        return std::pair(Value(new List()), illegal_operation());
     }
-    return std::pair(new_list, new Error(Position(), Position(), "", ""));
+    return std::pair(Value(new_list), nullptr);
 }
 
-std::pair<Value*, Error*> List::divided_by(Value* other) {
-    std::pair<Value*, Error*> ret;
-    if (auto index = dynamic_cast<Number*>(other)) {
+std::pair<Value, Error*> List::divided_by(Value other) {
+    if (other.kind == NUMBER_VALUE) {
+        int64_t index = other.getAsInt();
         // check if it is negative, and if negative, access from end
-        if (index->getAsInt() < 0) {
-            index = new Number(static_cast<int64_t>(elements.size() + index->getAsInt()));
+        if (index < 0) {
+            index = static_cast<int64_t>(elements.size()) + index;
         }
-        if (index->getAsInt() >= elements.size() || index->getAsInt() < 0) {
-            return std::pair(new List(), new RuntimeError(pos_start, pos_end, "Index out of range", context));
+        if (index >= static_cast<int64_t>(elements.size()) || index < 0) {
+            return std::pair(Value(new List()), new RuntimeError(Position(), Position(), "Index out of range", current_context));
         }
-        ret = std::pair(elements[index->getAsInt()], new Error(Position(), Position(), "", ""));
-        return ret;
+        return std::pair(elements[index], nullptr);
     } else {
-        return std::pair(new List(), illegal_operation(other));
+        return std::pair(Value(new List()), illegal_operation());
     }
 }
 
 List* List::copy() {
     List* list = new List(elements);
-    list->set_pos(pos_start, pos_end);
-    list->set_context(context);
     return list;
 }
 
 // ************REPRESENTATION METHODS************
 
-std::string Number::repr() {
-    if (type == INTEGER) {
-        return std::to_string(int_value);
-    } else {
-        return std::to_string(float_value);
-    }
-}
-
 std::string String::repr() {
     return value;
 }
@@ -3014,13 +5264,12 @@ std::string String::repr() {
 std::string List::repr() {
     std::string str = "[";
     for (int i = 0; i < elements.size(); i++) {
-        if (auto element = dynamic_cast<String*>(elements[i])) {
-            str += element->repr();
-        } else if (auto element = dynamic_cast<Number*>(elements[i])) {
-            str += element->repr();
-        } else if (auto element = dynamic_cast<List*>(elements[i])) {
-            str += element->repr();
-        } 
+        switch (elements[i].kind) {
+            case STRING_VALUE:
+            case NUMBER_VALUE:
+            case LIST_VALUE: str += elements[i].repr(); break;
+            default: break;
+        }
         if (i != elements.size() - 1) {
             str += ", ";
         }
@@ -3032,15 +5281,16 @@ std::string List::repr() {
 // ************RUN FUNCTION************
 
 std::string run_script_cpp(std::string script) {
-    std::pair<Value*, Error*> out = run("<stdin>", script);
-    Value* value = out.first;
+    std::pair<Value, Error*> out = run("<stdin>", script);
+    output_buffer.flush(); // the page shows what was printed before the result
+    Value value = out.first;
     Error* error = out.second;
     std::string result;
 
-    if (error->err_name != "" && error->err_name != "EOF") {
+    if (error != nullptr) {
         result = error->as_string();
     } else {
-        std::string out_value = value->repr();
+        std::string out_value = value.repr();
         // Split output by newlines
         size_t pos = 0;
         size_t last_pos = 0;
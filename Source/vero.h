@@ -3,14 +3,24 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cmath>
 #include <map>
+#include <deque>
+#include <unordered_set>
+#include <unordered_map>
 #include <algorithm>
 #include <cstdint>
+#include <limits>
+#include <cstddef>
 #include <tuple>
 #include <fstream>
 #include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <chrono>
+#include <filesystem>
 
 std::string run_script_cpp(std::string script);
 void initialize_global_symbol_table();
@@ -19,6 +29,14 @@ void initialize_global_symbol_table();
 #include <emscripten/emscripten.h>
 #endif
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define VERO_HAS_MMAP
+#endif
+
 #ifdef __EMSCRIPTEN__
 extern "C" {
     EMSCRIPTEN_KEEPALIVE
@@ -42,54 +60,199 @@ bool is_letter_or_digit(char c);
 
 // Forward declarations
 class Value;
-class Number;
+class Object;
 class Function;
 class RuntimeResult;
 class FuncDefNode;
 class Node;
 class Error;
+class Chunk;
+enum OpCode : uint8_t;
+
+// ************SOURCE FILES************
+
+// Every script is stored once here and positions refer to it by id, so
+// tokens, nodes, values and errors don't carry copies of the source text.
+// Id 0 is the empty file used by default-constructed positions. Any other
+// file is held by the arena parsed from it and by the errors that point into
+// it, and is freed at its last release, after which its id is reused.
+class SourceFile {
+    public:
+        std::string name;
+        std::string text;
+        uint64_t hash = 0; // of the name and the text, to find the entry for a source again
+        std::vector<int> line_starts;
+        int references = 0;
+        SourceFile(std::string name, std::string text);
+        int line_at(int index) const;
+        int col_at(int index) const;
+        std::string line_text(int line) const;
+};
+
+int register_source_file(std::string file_name, std::string file_text); // not yet held
+const SourceFile& source_file(int file_id);
+void retain_source_file(int file_id);
+void release_source_file(int file_id);
 
 // ************POSITION************
 
 class Position {
     public:
         int index;
-        int line;
-        int col;
-        std::string file_name;
-        std::string file_text;
+        int file_id;
         Position();
-        Position(int index, int line, int col, std::string file_name, std::string file_text);
+        Position(int index, int file_id);
         Position copy();
         void advance(char current_char='\0');
+        int line() const;
+        int col() const;
+        const std::string& file_name() const;
+        const std::string& file_text() const;
+};
+
+// ************VALUE************
+
+enum ValueKind : uint8_t {
+    NUMBER_VALUE,
+    STRING_VALUE,
+    LIST_VALUE,
+    FUNCTION_VALUE,
+    BUILTIN_FUNCTION_VALUE
+};
+
+// Values are passed around by value. Numbers (null is the integer 0) are held
+// inline so arithmetic never allocates; strings, lists and functions are boxed
+// as an Object on the heap.
+class Value {
+    public:
+        ValueKind kind; // dispatch tag, so operators can switch instead of dynamic_cast
+        // only meaningful for numbers; UNBOUND marks an empty variable slot and
+        // never leaves it
+        enum Type : uint8_t { INTEGER, FLOAT, UNBOUND } type;
+        union {
+            int64_t int_value;
+            double float_value;
+            Object* object;
+        };
+        Value();
+        Value(int64_t v);
+        Value(double v);
+        Value(Object* object);
+        static Value unbound();
+        bool is_bound() const { return type != UNBOUND; }
+        bool is_callable() const;
+        double getAsFloat() const;
+        int64_t getAsInt() const;
+        template <typename T> T* as() const { return static_cast<T*>(object); }
+        std::pair<Value, Error*> added_to(Value other) const;
+        std::pair<Value, Error*> subtracted_by(Value other) const;
+        std::pair<Value, Error*> multiplied_by(Value other) const;
+        std::pair<Value, Error*> divided_by(Value other) const;
+        std::pair<Value, Error*> raised_to(Value other) const;
+        std::pair<Value, Error*> get_comparison_eq(Value other) const;
+        std::pair<Value, Error*> get_comparison_ne(Value other) const;
+        std::pair<Value, Error*> get_comparison_lt(Value other) const;
+        std::pair<Value, Error*> get_comparison_gt(Value other) const;
+        std::pair<Value, Error*> get_comparison_lte(Value other) const;
+        std::pair<Value, Error*> get_comparison_gte(Value other) const;
+        std::pair<Value, Error*> anded_with(Value other) const;
+        std::pair<Value, Error*> ored_with(Value other) const;
+        std::pair<Value, Error*> notted() const;
+        Value copy() const;
+        bool is_true() const;
+        std::string repr() const;
 };
 
 // ************SYMBOL TABLE************
 
+// Every identifier is stored once here and is referred to by its symbol, a
+// small integer, from then on, so that names are compared and looked up by id
+// instead of by their text. The names live in a deque so that the views of
+// them handed out stay valid as more are added.
+//
+// Names are found through an open-addressing hash table with linear probing.
+// Each entry keeps the hash of its name, so probes only compare the text of
+// names whose hash matches and growing the table never hashes a name again.
+class Interner {
+    public:
+        struct Entry {
+            uint64_t hash;
+            int symbol; // -1 for an empty entry
+        };
+        std::vector<Entry> table; // size is a power of two, at most half full
+        std::deque<std::string> names;
+        int intern(std::string_view name);
+        int find(std::string_view name) const; // -1 if the name was never interned
+        std::string_view name(int symbol) const;
+        int size() const;
+    private:
+        size_t probe(std::string_view name, uint64_t hash) const;
+        void grow();
+};
+
+extern Interner interner;
+
+// Holds the globals in an array indexed by symbol, so that resolved code can
+// address them directly. Every name the Resolver meets has an entry here,
+// whether or not a global of that name is ever bound; lookups by name remain
+// for dynamic uses such as registering the builtins.
 class SymbolTable {
     public:
-        SymbolTable* parent;
-        std::map<std::string, Value*> symbols;
-        SymbolTable(SymbolTable* parent = nullptr);
-        Value* get(std::string name);
-        void set(std::string name, Value* value);
-        void remove(std::string name);
+        std::vector<Value> values; // Value::unbound() until assigned
+        std::vector<int> shadows; // how many functions whose tree is still alive have a local of that name
+        std::vector<uint32_t> versions; // bumped whenever the global is bound or shadowed, for CallNode's cache
+        int symbol(std::string_view name);
+        Value* get(std::string_view name);
+        void bind(int symbol, Value value);
+        void set(std::string_view name, Value value);
+        void remove(std::string_view name);
 };
 
+extern SymbolTable global_symbol_table;
 void initialize_global_symbol_table();
 
 // ************CONTEXT************
 
+// Vero is dynamically scoped: a name that is not local to the running function
+// is looked up in the locals of its callers, innermost first, and then in the
+// globals. Function calls keep their locals in slots laid out by the Resolver.
 class Context {
     public:
-        std::string display_name;
+        std::string_view display_name; // interned or a literal, never owned
         Context* parent;
         Position parent_entry_pos;
-        SymbolTable symbol_table;
+        Value* slots = nullptr; // on the frame stack, one per entry of locals
+        const std::vector<int>* locals = nullptr; // symbol of each slot, nullptr outside function calls
         Context();
-        Context(std::string display_name, Context* parent = nullptr, Position parent_entry_pos = Position());
+        Context(std::string_view display_name, Context* parent = nullptr, Position parent_entry_pos = Position());
+        Value* lookup(int symbol);
+        Value* get(int slot, int symbol);
+        void set(int slot, int symbol, Value value);
 };
 
+// The innermost active context; following parent pointers from it walks the
+// call stack, which is where runtime errors take their traceback from
+extern Context* current_context;
+
+// Slots of the calls in progress. A call pushes its frame when it starts and
+// pops it when it returns, so frames come and go in stack order and a call
+// allocates nothing. The slots are kept in blocks that are never moved or
+// freed, so a frame stays put while deeper calls push theirs.
+class FrameStack {
+    public:
+        static constexpr size_t BLOCK_SIZE = 16 * 1024;
+        struct Block {
+            std::vector<Value> values;
+            size_t used;
+        };
+        std::vector<Block> blocks;
+        size_t top = 0; // the block frames are pushed onto
+        Value* push(size_t count); // count unbound slots
+        void pop(size_t count);
+};
+
+extern FrameStack frames;
+
 // ************ERRORS************
 
 class Error {
@@ -98,9 +261,13 @@ class Error {
         Position pos_end;
         std::string err_name;
         std::string details;
+        std::vector<int> sources; // the files its positions are in, held until it is freed
         Error(Position pos_start, Position pos_end, std::string err_name, std::string details);
+        Error(const Error&) = delete;
         virtual std::string as_string();
-        virtual ~Error() = default;
+        void hold_source(int file_id);
+        void set_start(Position pos_start); // e.g. to the call an error was raised under
+        virtual ~Error();
 };
 
 class IllegalCharError : public Error {
@@ -118,25 +285,67 @@ class ExpectedCharError : public Error {
         ExpectedCharError(Position pos_start, Position pos_end, std::string details);
 };
 
+// One frame of a traceback, captured when the error is raised since the
+// contexts it was raised in are gone by the time it is printed
+struct TracebackEntry {
+    std::string display_name;
+    Position entry_pos;
+};
+
 class RuntimeError : public Error {
     public:
-        Context context;
-        RuntimeError(Position pos_start, Position pos_end, std::string details, Context context);
+        std::vector<TracebackEntry> traceback; // innermost frame first
+        RuntimeError(Position pos_start, Position pos_end, std::string details, Context* context);
+        void set_pos(Position pos_start, Position pos_end);
         std::string as_string() override;
         std::string generate_traceback();
 };
 
 // ************TOKENS************
 
+enum TokenType : uint8_t {
+    NO_TOKEN, // default-constructed tokens
+    INT_TOKEN,
+    FLOAT_TOKEN,
+    STRING_TOKEN,
+    PLUS_TOKEN,
+    MINUS_TOKEN,
+    POWER_TOKEN,
+    MUL_TOKEN,
+    DIV_TOKEN,
+    LPAREN_TOKEN,
+    RPAREN_TOKEN,
+    LSQUARE_TOKEN,
+    RSQUARE_TOKEN,
+    LBRACE_TOKEN,
+    RBRACE_TOKEN,
+    EOF_TOKEN,
+    IDENTIFIER_TOKEN,
+    EQUALS_TOKEN,
+    KEYWORD_TOKEN,
+    EE_TOKEN,
+    NE_TOKEN,
+    LT_TOKEN,
+    GT_TOKEN,
+    LTE_TOKEN,
+    GTE_TOKEN,
+    COMMA_TOKEN,
+    ARROW_TOKEN,
+    NEWLINE_TOKEN
+};
+
+// Tokens are small and trivially copyable. The value of an identifier, keyword
+// or number is a view into the source text, which the source registry keeps
+// alive; a string literal's value is its raw text (see string_value).
 class Token {
     public:
-        std::string type;
-        std::string value;
+        TokenType type;
+        std::string_view value;
         Position pos_start;
         Position pos_end;
-        bool matches(std::string type_, std::string value_);
+        bool matches(TokenType type_, std::string_view value_) const;
         Token();
-        Token(std::string type, std::string value = "", Position* pos_start = nullptr, Position* pos_end = nullptr);
+        Token(TokenType type, std::string_view value = "", Position* pos_start = nullptr, Position* pos_end = nullptr);
         std::string repr() const;
         friend std::ostream& operator<<(std::ostream& os, const Token& obj);
 };
@@ -146,9 +355,11 @@ class Token {
 class Lexer {
     public:
         std::string file_name;
-        std::string text;
+        std::string_view text; // the registered copy of the source
+        int file_id;
         Lexer(std::string file_name, std::string text);
-        Position pos = Position(-1, 0, -1, file_name, text);
+        Lexer(int file_id); // a source that is already registered
+        Position pos;
         char current_char = '\0';
         void advance();
         std::pair<std::vector<Token>, Error*> make_tokens();
@@ -163,11 +374,64 @@ class Lexer {
         void skip_comment();
 };
 
+std::string string_value(std::string_view raw);
+
+// ************ARENA************
+
+// Owns the nodes and parse results of one run(), and the bytecode compiled
+// from them, and frees them all at once. It is reference counted: run() holds
+// it while the script executes and every Function made from one of its
+// definitions holds it for as long as it lives.
+class Arena {
+    public:
+        static const size_t BLOCK_SIZE = 32 * 1024;
+        static size_t live_bytes; // held by all arenas
+        static size_t high_water; // the most live_bytes has been
+        std::vector<char*> blocks;
+        size_t block_used = BLOCK_SIZE; // bytes used in the last block
+        size_t bytes = 0; // bytes handed out by this arena
+        std::vector<Node*> nodes; // destroyed with the arena
+        Chunk* chunk = nullptr; // compiled from the tree on its first run by the VM
+        int file_id = 0; // the source the tree was parsed from, held by the arena
+        int references = 1;
+        Arena() = default;
+        Arena(int file_id);
+        Arena(const Arena&) = delete;
+        ~Arena();
+        void* allocate(size_t size);
+        void retain();
+        void release();
+};
+
+extern Arena* current_arena; // where nodes are allocated, nullptr outside of parsing
+
 // ************NODES************
 
+enum NodeKind : uint8_t {
+    NUMBER_NODE,
+    STRING_NODE,
+    VAR_ACCESS_NODE,
+    VAR_ASSIGN_NODE,
+    BIN_OP_NODE,
+    UNARY_OP_NODE,
+    IF_NODE,
+    FOR_NODE,
+    WHILE_NODE,
+    FUNC_DEF_NODE,
+    CALL_NODE,
+    LIST_NODE,
+    RETURN_NODE,
+    CONTINUE_NODE,
+    BREAK_NODE
+};
+
 class Node {
     public:
+        const NodeKind kind; // dispatch tag, so visitors can switch instead of dynamic_cast
+        Node(NodeKind kind);
         virtual ~Node() = default;
+        static void* operator new(size_t size);
+        static void operator delete(void* node) {} // freed with its arena
         virtual std::string repr() const = 0;
         Position pos_start;
         Position pos_end;
@@ -176,6 +440,7 @@ class Node {
 class StringNode : public Node {
     public:
         Token token;
+        std::string value; // the literal with its escapes processed
         StringNode();
         StringNode(Token token);
         std::string repr() const override;
@@ -184,15 +449,22 @@ class StringNode : public Node {
 class NumberNode : public Node {
     public:
         Token token;
+        Value value; // read from the token once, when the node is made
         NumberNode();
         NumberNode(Token token);
+        NumberNode(Value value, Position pos_start, Position pos_end);
         std::string repr() const override;
         friend std::ostream& operator<<(std::ostream& os, const NumberNode& obj);
 };
 
+// Nodes that name a variable are annotated by the Resolver: symbol is the
+// name's index in the global symbol table and slot its index in the frame of
+// the enclosing function, or -1 if it is not a local there.
 class VarAccessNode : public Node {
     public:
         Token var_name_token;
+        int symbol = -1;
+        int slot = -1;
         VarAccessNode();
         VarAccessNode(Token var_name_token);
         std::string repr() const override;
@@ -201,10 +473,11 @@ class VarAccessNode : public Node {
 class VarAssignNode : public Node {
     public:
         Token var_name_token;
+        int symbol = -1;
+        int slot = -1;
         Node* value_node;
         VarAssignNode();
         VarAssignNode(Token var_name_token, Node* value_node);
-        ~VarAssignNode();
         std::string repr() const override;
 };
 
@@ -213,10 +486,10 @@ class BinOpNode : public Node {
         Node* left;
         Token op;
         Node* right;
+        OpCode op_code; // the operator the token stands for
         BinOpNode();
         BinOpNode(Node* left, Token token, Node* right);
         std::string repr() const override;
-        ~BinOpNode();
         friend std::ostream& operator<<(std::ostream& os, const BinOpNode& obj);
 };
 
@@ -227,7 +500,6 @@ class UnaryOpNode : public Node {
         UnaryOpNode();
         UnaryOpNode(Token op, Node* node);
         std::string repr() const override;
-        ~UnaryOpNode();
         friend std::ostream& operator<<(std::ostream& os, const UnaryOpNode& obj);
 };
 
@@ -237,12 +509,13 @@ class IfNode : public Node {
         IfNode();
         IfNode(std::vector<std::tuple<Node*, Node*, bool>> cases);
         std::string repr() const override;
-        ~IfNode();
 };
 
 class ForNode : public Node {
     public:
         Token var_name_token;
+        int symbol = -1;
+        int slot = -1;
         Node* start_value_node;
         Node* end_value_node;
         Node* step_value_node;
@@ -250,7 +523,6 @@ class ForNode : public Node {
         bool should_return_null;
         ForNode();
         ForNode(Token var_name_token, Node* start_value_node, Node* end_value_node, Node* step_value_node, Node* body_node, bool should_return_null);
-        ~ForNode();
         std::string repr() const override;
 };
 
@@ -261,7 +533,6 @@ class WhileNode : public Node {
         bool should_return_null;
         WhileNode();
         WhileNode(Node* condition_node, Node* body_node, bool should_return_null);
-        ~WhileNode();
         std::string repr() const override;
 };
 
@@ -271,9 +542,14 @@ class FuncDefNode: public Node {
         std::vector<Token> arg_name_tokens;
         Node* body_node;
         bool should_auto_return;
+        int symbol = -1; // the function's own name, -1 if anonymous
+        int slot = -1;
+        std::vector<int> locals; // symbol of each slot of its frame, arguments first
+        std::vector<int> shadowed; // the names the Resolver counted in SymbolTable::shadows for it
+        Arena* arena = current_arena;
         FuncDefNode();
         FuncDefNode(Token var_name_token, std::vector<Token> arg_name_tokens, Node* body_node, bool should_auto_return);
-        ~FuncDefNode();
+        ~FuncDefNode() override;
         std::string repr() const override;
 };
 
@@ -281,18 +557,23 @@ class CallNode : public Node {
     public:
         Node* node_to_call;
         std::vector<Node*> args;
+        std::string_view display_name = "<<anonymous>>"; // the callee's frame in tracebacks, "<f>" when calling f
+        bool tail_call = false; // the value of a return, so a call to the running function can reuse its frame
+        // the function a global callee was bound to, kept until the global's version changes
+        Object* cached_callee = nullptr;
+        int cached_symbol = -1;
+        uint32_t cached_version = 0;
         CallNode();
         CallNode(Node* node_to_call, std::vector<Node*> args);
-        ~CallNode();
         std::string repr() const override;
 };
 
 class ListNode : public Node {
     public:
         std::vector<Node*> elements;
+        bool should_return_null = false; // a block of statements whose value is never read
         ListNode();
         ListNode(std::vector<Node*> elements, Position pos_start, Position pos_end);
-        ~ListNode();
         std::string repr() const override;
 };
 
@@ -301,7 +582,6 @@ class ReturnNode : public Node {
         Node* node_to_return;
         ReturnNode();
         ReturnNode(Node* node_to_return, Position pos_start, Position pos_end);
-        ~ReturnNode();
         std::string repr() const override;
 };
 
@@ -328,231 +608,347 @@ class ParseResult {
         Node* ast;
         Error* error;
         int advance_count = 0;
-        int to_reverse_count = 0;
         ParseResult();
         ParseResult(Node* ast, Error* error);
+        static void* operator new(size_t size);
+        static void operator delete(void* result) {} // freed with its arena
         Node* reg(ParseResult* result);
         void reg_advancement();
         template <typename T>
         ParseResult* success(T* n);
         ParseResult* failure(Error* error);
-        Node* try_register(ParseResult* result);
 };
 
+// ************RESOLVER************
+
+// Runs between parsing and execution and annotates variable nodes with where
+// their values live. Within a function every argument and every name it
+// assigns (let, for or a named func) is a local with its own slot.
+class Resolver {
+    public:
+        struct Scope {
+            FuncDefNode* function;
+            std::map<int, int> slots; // symbol -> slot
+        };
+        std::vector<Scope> scopes;
+        void resolve(Node* node);
+        void resolve_name(std::string_view name, int& symbol, int& slot);
+        void resolve_function(FuncDefNode* node);
+        void declare(Scope& scope, int symbol);
+        void declare_locals(Scope& scope, Node* node);
+        void discard_value(Node* node);
+};
+
+std::vector<Node*> child_nodes(Node* node);
+
+// ************OPTIMIZER************
+
+// Runs once over a script's tree, before its first run. Operators applied to
+// number literals are replaced with their result, and the cases of an if that
+// can never be taken are dropped; a case that is always taken is left without
+// a condition (nullptr). Names are never folded, not even pi, since every
+// variable can be reassigned.
+class Optimizer {
+    public:
+        Node* optimize(Node* node);
+        Node* fold_bin_op(BinOpNode* node);
+        Node* fold_unary_op(UnaryOpNode* node);
+        Node* prune_if(IfNode* node);
+        NumberNode* make_literal(Value value, Node* node);
+        std::string source_text(Node* node);
+        void report(const Position& pos, const std::string& change);
+};
+
+// Whether applying op to two integers would overflow an int64_t, which is
+// undefined behaviour, so such an operator is never folded
+bool integer_overflow(OpCode op, int64_t left, int64_t right);
+
 // ************PARSER************
 
+// Binding strength of the binary operators, 0 is used for tokens that aren't one
+enum Precedence {
+    LOGICAL_PRECEDENCE = 1,
+    COMPARISON_PRECEDENCE,
+    SUM_PRECEDENCE,
+    PRODUCT_PRECEDENCE,
+    POWER_PRECEDENCE,
+};
+
+struct BinaryOperator {
+    TokenType type;
+    std::string_view keyword; // for keyword operators, empty otherwise
+    int precedence;
+};
+
 class Parser {
     public:
-        std::vector<Token> tokens;
+        const std::vector<Token>& tokens;
         Token current_token;
         int token_index;
-        Parser(std::vector<Token> tokens);
+        Parser(const std::vector<Token>& tokens);
         Token advance();
+        Token rewind(int token_index);
+        bool at_builtin_call() const;
+        bool at_expression_start() const;
+        bool at_statement_start() const;
+        int binary_precedence() const;
         ParseResult* atom();
-        ParseResult* factor();
-        ParseResult* power();
-        ParseResult* term();
+        ParseResult* call();
+        ParseResult* unary_expr(int min_precedence);
+        ParseResult* binary_expr(int min_precedence);
         ParseResult* statement();
         ParseResult* statements();
         ParseResult* expr();
         ParseResult* parse();
-        ParseResult* comp_expr();
-        ParseResult* arith_expr();
         ParseResult* if_expr();
         ParseResult* for_expr();
         ParseResult* while_expr();
         ParseResult* func_def();
         ParseResult* list_expr();
-        ParseResult* call();
-        ParseResult* bin_op(ParseResult* (Parser::*func1)(), std::vector<std::string> ops, ParseResult* (Parser::*func2)()=nullptr, std::vector<std::vector<std::string>> ops_with_values=std::vector<std::vector<std::string>>());
-        std::pair<std::vector<std::tuple<Node*, Node*, bool>>, ParseResult*> if_expr_cases(std::string case_keyword);
+        std::pair<std::vector<std::tuple<Node*, Node*, bool>>, ParseResult*> if_expr_cases(std::string_view case_keyword);
         std::pair<std::vector<std::tuple<Node*, Node*, bool>>, ParseResult*> if_expr_b_or_c();
         std::pair<std::vector<std::tuple<Node*, Node*, bool>>, ParseResult*> if_expr_b();
-        Token reverse(int amount=1);
 };
 
 // ************VALUES************
 
-class Value {
+// The arguments of a call, viewed in place on the caller's VM stack or on
+// the frame stack, so that calls don't gather them into a vector
+struct Arguments {
+    const Value* values;
+    size_t count;
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const Value& operator[](size_t index) const { return values[index]; }
+    const Value* begin() const { return values; }
+    const Value* end() const { return values + count; }
+};
+
+// Where a function is called from: the span of the call, which its errors
+// point at, and the name its frame is shown with in tracebacks
+struct CallSite {
+    Position pos_start;
+    Position pos_end;
+    std::string_view display_name;
+};
+
+// Base class of the boxed values. Every Object is owned by the heap, which
+// frees it once it is no longer reachable.
+class Object {
     public:
-        Position pos_start = Position();
-        Position pos_end = Position();
-        Context context;
-        void set_pos(Position pos_start=Position(), Position pos_end=Position());
-        Value* set_context(Context context=Context());
-        Value();
-        virtual ~Value() = default;
-        virtual std::pair<Value*, Error*> added_to(Value* other);
-        virtual std::pair<Value*, Error*> subtracted_by(Value* other);
-        virtual std::pair<Value*, Error*> multiplied_by(Value* other);
-        virtual std::pair<Value*, Error*> divided_by(Value* other);
-        virtual std::pair<Value*, Error*> raised_to(Value* other);
-        virtual std::pair<Value*, Error*> get_comparison_eq(Value* other);
-        virtual std::pair<Value*, Error*> get_comparison_ne(Value* other);
-        virtual std::pair<Value*, Error*> get_comparison_lt(Value* other);
-        virtual std::pair<Value*, Error*> get_comparison_gt(Value* other);
-        virtual std::pair<Value*, Error*> get_comparison_lte(Value* other);
-        virtual std::pair<Value*, Error*> get_comparison_gte(Value* other);
-        virtual std::pair<Value*, Error*> anded_with(Value* other);
-        virtual std::pair<Value*, Error*> ored_with(Value* other);
-        virtual std::pair<Value*, Error*> notted();
-        virtual std::pair<RuntimeResult*, Error*> execute(std::vector<Value*> args);
-        virtual Value* copy() = 0;
+        const ValueKind kind;
+        bool marked = false; // reachable in the collection in progress
+        Object* next_object = nullptr;
+        Object(ValueKind kind);
+        Object(const Object&) = delete; // copies must go through copy() so the heap sees them
+        virtual ~Object() = default;
+        static void* operator new(size_t size);
+        static void operator delete(void* object, size_t size);
+        virtual std::pair<Value, Error*> added_to(Value other);
+        virtual std::pair<Value, Error*> subtracted_by(Value other);
+        virtual std::pair<Value, Error*> multiplied_by(Value other);
+        virtual std::pair<Value, Error*> divided_by(Value other);
+        virtual std::pair<Value, Error*> raised_to(Value other);
+        virtual std::pair<Value, Error*> get_comparison_eq(Value other);
+        virtual std::pair<Value, Error*> get_comparison_ne(Value other);
+        virtual std::pair<Value, Error*> get_comparison_lt(Value other);
+        virtual std::pair<Value, Error*> get_comparison_gt(Value other);
+        virtual std::pair<Value, Error*> get_comparison_lte(Value other);
+        virtual std::pair<Value, Error*> get_comparison_gte(Value other);
+        virtual std::pair<Value, Error*> anded_with(Value other);
+        virtual std::pair<Value, Error*> ored_with(Value other);
+        virtual std::pair<Value, Error*> notted();
+        virtual RuntimeResult execute(Arguments args, const CallSite& call);
+        virtual Object* copy() = 0;
         virtual bool is_true();
-        RuntimeError* illegal_operation(Value* other=nullptr);  
-        std::string repr();  
 };
 
-class String : public Value {
+RuntimeError* illegal_operation();
+
+class String : public Object {
     public:
         std::string value;
-        Position pos_start;
-        Position pos_end;
         String();
         String(std::string value);
         bool is_true() override;
         String* copy() override;
-        std::pair<Value*, Error*> added_to(Value* other) override;
-        std::pair<Value*, Error*> multiplied_by(Value* other) override;
-        std::pair<Value*, Error*> get_comparison_eq(Value* other) override;
-        std::pair<Value*, Error*> get_comparison_ne(Value* other) override;
+        std::pair<Value, Error*> added_to(Value other) override;
+        std::pair<Value, Error*> multiplied_by(Value other) override;
+        std::pair<Value, Error*> get_comparison_eq(Value other) override;
+        std::pair<Value, Error*> get_comparison_ne(Value other) override;
         std::string repr();
 };
 
-class Number : public Value {
+// Functions are called in place, the call site and arguments are passed to
+// execute() rather than stored on the function
+class BaseFunction : public Object {
     public:
-        enum Type { INTEGER, FLOAT } type;
-        union {
-            int64_t int_value;
-            double float_value;
-        };
-        Position pos_start;
-        Position pos_end;
-        Number();
-        Number(int64_t v);
-        Number(double v);
-        double getAsFloat() const;
-        int64_t getAsInt() const;
-        bool is_null = false;
-        bool is_true() override;
-        Error* added_to(void* other);
-        std::pair<Value*, Error*> added_to(Value* other) override;
-        Error* subtracted_by(void* other);
-        std::pair<Value*, Error*> subtracted_by(Value* other) override;
-        Error* multiplied_by(void* other);
-        std::pair<Value*, Error*> multiplied_by(Value* other) override;
-        Error* divided_by(void* other);
-        std::pair<Value*, Error*> divided_by(Value* other) override;
-        Error* raised_to(void* other);
-        std::pair<Value*, Error*> raised_to(Value* other) override;
-        Error* get_comparison_eq(void* other);
-        std::pair<Value*, Error*> get_comparison_eq(Value* other) override;;
-        Error* get_comparison_ne(void* other);
-        std::pair<Value*, Error*> get_comparison_ne(Value* other) override;;
-        Error* get_comparison_lt(void* other);
-        std::pair<Value*, Error*> get_comparison_lt(Value* other) override;;
-        Error* get_comparison_gt(void* other);
-        std::pair<Value*, Error*> get_comparison_gt(Value* other) override;;
-        Error* get_comparison_lte(void* other);
-        std::pair<Value*, Error*> get_comparison_lte(Value* other) override;;
-        Error* get_comparison_gte(void* other);
-        std::pair<Value*, Error*> get_comparison_gte(Value* other) override;;
-        Error* anded_with(void* other);
-        std::pair<Value*, Error*> anded_with(Value* other) override;
-        Error* ored_with(void* other);
-        std::pair<Value*, Error*> ored_with(Value* other) override;
-        std::pair<Value*, Error*> notted() override;
-        Number* copy() override;
-        std::string repr();
-};
-
-class BaseFunction : public Value {
-    public:
-        std::string name;
-        std::vector<Token> arg_name_tokens;
-        Node* body_node;
-        BaseFunction(Token n);
-        void generate_new_context(Context& new_context);
-        RuntimeResult* check_args(std::vector<Value*> args, std::vector<Token> arg_name_tokens);
-        void populate_args(std::vector<Value*> args, std::vector<Token> arg_name_tokens, Context& new_context);
-        RuntimeResult check_and_populate_args(std::vector<Value*> args, std::vector<Token> arg_name_tokens, Context& new_context);
+        BaseFunction(ValueKind kind);
+        void generate_new_context(Context& new_context, const CallSite& call);
+        Error* check_args(Arguments args, size_t arity, const CallSite& call);
+        void populate_args(Arguments args, Context& new_context);
 };
 
 class Function : public BaseFunction {
     public:
-        std::string name;
         Token var_name_token;
-        std::vector<Token> arg_name_tokens;
+        const std::vector<Token>* arg_name_tokens; // FuncDefNode::arg_name_tokens
         Node* body_node;
-        Position pos_start;
-        Position pos_end;
         bool should_auto_return;
-        Function();
-        Function(Token var_name_token, std::vector<Token> arg_name_tokens, Node* body_node, bool should_auto_return);
-        std::pair<RuntimeResult*, Error*> execute(std::vector<Value*> args) override;
+        Chunk* chunk = nullptr; // compiled body, nullptr when running on the AST interpreter
+        const std::vector<int>* locals = nullptr; // frame layout from FuncDefNode::locals
+        Arena* arena = nullptr; // owns body_node, arg_name_tokens and locals
+        Function(Token var_name_token, const std::vector<Token>* arg_name_tokens, Node* body_node, bool should_auto_return);
+        ~Function();
+        void hold(Arena* arena);
+        RuntimeResult execute(Arguments args, const CallSite& call) override;
         Function* copy() override;
         std::string repr();
 };
 
-class List : public Value {
+class List : public Object {
     public:
-        std::vector<Value*> elements;
-        Position pos_start;
-        Position pos_end;
+        std::vector<Value> elements;
         List();
-        ~List();
-        List(std::vector<Value*> elements);
+        List(std::vector<Value> elements);
         List* copy() override;
-        std::pair<Value*, Error*> added_to(Value* other) override;
-        std::pair<Value*, Error*> multiplied_by(Value* other) override;
-        std::pair<Value*, Error*> subtracted_by(Value* other) override;
-        std::pair<Value*, Error*> divided_by(Value* other) override;
+        std::pair<Value, Error*> added_to(Value other) override;
+        std::pair<Value, Error*> multiplied_by(Value other) override;
+        std::pair<Value, Error*> subtracted_by(Value other) override;
+        std::pair<Value, Error*> divided_by(Value other) override;
         std::string repr();
 };
 
+// A built-in's native code. context is the frame made for the call, whose
+// parent is the caller
+typedef RuntimeResult (*NativeFunction)(Arguments args, const CallSite& call, Context& context);
+
+const int VARIADIC = -1; // arity of a built-in that takes any number of arguments
+
 class BuiltinFunction : public BaseFunction {
     public:
-        std::string name;
-        BuiltinFunction(Token name);
-        std::pair<RuntimeResult*, Error*> execute(std::vector<Value*> args) override;
+        std::string_view name; // interned
+        NativeFunction function;
+        int arity;
+        BuiltinFunction(std::string_view name, NativeFunction function, int arity);
+        RuntimeResult execute(Arguments args, const CallSite& call) override;
         BuiltinFunction* copy() override;
         std::string repr();
 
         // functions
-        RuntimeResult* func_print(std::vector<Value*> args);
-        RuntimeResult* func_input(std::vector<Value*> args);
-        RuntimeResult* func_input_int(std::vector<Value*> args);
-        RuntimeResult* func_clear(std::vector<Value*> args);
-        RuntimeResult* func_is_number(std::vector<Value*> args);
-        RuntimeResult* func_is_string(std::vector<Value*> args);
-        RuntimeResult* func_is_list(std::vector<Value*> args);
-        RuntimeResult* func_is_function(std::vector<Value*> args);
-        RuntimeResult* func_append(std::vector<Value*> args);
-        RuntimeResult* func_pop(std::vector<Value*> args);
-        RuntimeResult* func_extend(std::vector<Value*> args);
-        RuntimeResult* func_len(std::vector<Value*> args);
-        RuntimeResult* func_run(std::vector<Value*> args, Context& context);  
+        static RuntimeResult func_print(Arguments args, const CallSite& call, Context& context);
+        static RuntimeResult func_input(Arguments args, const CallSite& call, Context& context);
+        static RuntimeResult func_input_int(Arguments args, const CallSite& call, Context& context);
+        static RuntimeResult func_clear(Arguments args, const CallSite& call, Context& context);
+        static RuntimeResult func_is_number(Arguments args, const CallSite& call, Context& context);
+        static RuntimeResult func_is_string(Arguments args, const CallSite& call, Context& context);
+        static RuntimeResult func_is_list(Arguments args, const CallSite& call, Context& context);
+        static RuntimeResult func_is_function(Arguments args, const CallSite& call, Context& context);
+        static RuntimeResult func_append(Arguments args, const CallSite& call, Context& context);
+        static RuntimeResult func_pop(Arguments args, const CallSite& call, Context& context);
+        static RuntimeResult func_extend(Arguments args, const CallSite& call, Context& context);
+        static RuntimeResult func_len(Arguments args, const CallSite& call, Context& context);
+        static RuntimeResult func_run(Arguments args, const CallSite& call, Context& context);
+        static RuntimeResult func_gc_stats(Arguments args, const CallSite& call, Context& context);
+        static RuntimeResult func_flush(Arguments args, const CallSite& call, Context& context);
+};
+
+struct BuiltinDefinition {
+    std::string_view name;
+    NativeFunction function;
+    int arity;
+};
+
+// The names in BUILTIN_FUNCTIONS. The lexer makes them keywords and the parser
+// reads one followed by arguments as a built-in call, so a new entry in the
+// table needs no change to either
+const std::vector<std::string_view>& builtin_names();
+
+// Binds a native function as a global, so embedders can add built-ins of their
+// own. A name that isn't in BUILTIN_FUNCTIONS is an identifier, and is called
+// like any other global
+void register_builtin(std::string_view name, NativeFunction function, int arity);
+
+// ************GARBAGE COLLECTOR************
+
+// Mark-and-sweep collector for Objects. Collections only happen at safe points
+// where every live value is reachable from a root: loop back-edges and calls in
+// the VM and the tree-walking Interpreter, and the start of a top-level run().
+class Heap {
+    public:
+        Object* objects = nullptr;
+        size_t object_count = 0;
+        size_t bytes_allocated = 0;
+        size_t next_collection = 1 << 20; // bytes_allocated that triggers the next collection
+        int collections = 0;
+        double total_pause_ms = 0;
+        double max_pause_ms = 0;
+        // operand stacks of the running VMs, innermost last; the ones past
+        // active_stacks are kept for reuse so that a call doesn't allocate one
+        std::deque<std::vector<Value>> stacks;
+        size_t active_stacks = 0;
+        std::unordered_set<Chunk*> chunks; // every compiled chunk, their constants are roots
+        std::vector<Value> roots; // values the Interpreter holds in C++ locals, see RootScope
+        void add(Object* object);
+        bool should_collect() const;
+        void collect();
+        void mark(Value value, std::vector<Object*>& worklist);
+};
+
+extern Heap heap;
+
+// Roots the values pushed through it until it goes out of scope, so that the
+// Interpreter's operands and partly built lists survive a collection in a
+// nested loop or call. Scopes nest, so they share heap.roots as a stack.
+class RootScope {
+    public:
+        size_t base;
+        RootScope();
+        ~RootScope();
+        void push(Value value);
+        std::vector<Value> values() const; // the ones pushed through this scope
+};
+
+// ************OUTPUT************
+
+// Everything scripts print goes through here rather than straight to
+// std::cout, so that printing a line doesn't cost a write to the terminal
+// or pipe, or in the browser a call into JavaScript. It is flushed once it
+// holds capacity bytes, before reading input, by flush() and at exit.
+class OutputBuffer {
+    public:
+        static const size_t DEFAULT_CAPACITY = 64 * 1024;
+        size_t capacity = DEFAULT_CAPACITY; // 0 writes every print straight away
+        std::string buffer;
+        ~OutputBuffer();
+        void write(std::string_view text);
+        void flush();
 };
 
+extern OutputBuffer output_buffer;
+
 // ************RUNTIME RESULT************
 
 class RuntimeResult {
     public:
-        Value* value = nullptr;
-        Error* error = new Error(Position(), Position(), "", "");
-        Value* func_return_value = nullptr;
+        Value value;
+        Error* error = nullptr;
+        Value func_return_value;
+        bool func_should_return = false;
+        bool func_should_tail_call = false; // the frame has been refilled with new arguments
         bool loop_should_continue = false;
         bool loop_should_break = false;
         void reset();
         RuntimeResult();
-        RuntimeResult(Value* value, Error* error);
-        Value* reg(RuntimeResult result);
-        RuntimeResult* success(Value* value);
+        RuntimeResult(Value value, Error* error);
+        Value reg(const RuntimeResult& result);
+        RuntimeResult* success(Value value);
         RuntimeResult* failure(Error* error);
-        RuntimeResult* success_return(Value* value);
+        RuntimeResult* success_return(Value value);
+        RuntimeResult* success_tail_call();
         RuntimeResult* success_continue();
         RuntimeResult* success_break();
-        bool should_return();
+        bool should_return() const;
 };
 
 // ************INTERPRETER************
@@ -579,10 +975,275 @@ class Interpreter {
         RuntimeResult visit_ReturnNode(ReturnNode* node, Context& context);
         RuntimeResult visit_ContinueNode(ContinueNode* node, Context& context);
         RuntimeResult visit_BreakNode(BreakNode* node, Context& context);
+        std::pair<Value, Error*> unary_operation(const Token& op, Value operand);
+};
+
+// ************BYTECODE************
+
+enum OpCode : uint8_t {
+    OP_CONSTANT,            // [constant] push a copy of a constant
+    OP_NULL,                // push a fresh null number
+    OP_LOAD_LOCAL,          // [slot, span] push a copy of a local of the running function
+    OP_LOAD_GLOBAL,         // [symbol, span] push a copy of any other variable
+    OP_STORE_LOCAL,         // [slot] bind the top of the stack (left on the stack)
+    OP_STORE_GLOBAL,        // [symbol] same as OP_STORE_LOCAL for a global
+    OP_MAKE_FUNCTION,       // [prototype] push a new function, binding it if named
+    OP_ADD,                 // [span] binary operators pop two values and push one
+    OP_SUBTRACT,
+    OP_MULTIPLY,
+    OP_DIVIDE,
+    OP_POWER,
+    OP_EQUAL,
+    OP_NOT_EQUAL,
+    OP_LESS,
+    OP_GREATER,
+    OP_LESS_EQUAL,
+    OP_GREATER_EQUAL,
+    OP_AND,
+    OP_OR,
+    OP_ADD_INT,             // [span] binary operators specialized by quicken()
+    OP_ADD_FLOAT,
+    OP_SUBTRACT_INT,
+    OP_SUBTRACT_FLOAT,
+    OP_MULTIPLY_INT,
+    OP_MULTIPLY_FLOAT,
+    OP_DIVIDE_INT,
+    OP_DIVIDE_FLOAT,
+    OP_EQUAL_NUMBER,
+    OP_NOT_EQUAL_NUMBER,
+    OP_LESS_NUMBER,
+    OP_GREATER_NUMBER,
+    OP_LESS_EQUAL_NUMBER,
+    OP_GREATER_EQUAL_NUMBER,
+    OP_NEGATE,              // unary operators replace the top of the stack
+    OP_NOT,
+    OP_BUILD_LIST,          // [count] pop count values into a new list
+    OP_NEW_LIST,            // push an empty loop accumulator
+    OP_LIST_APPEND,         // [depth] pop a value into the accumulator at depth
+    OP_LIST_APPEND_COPY,    // [depth] same as OP_LIST_APPEND but stores a copy
+    OP_FOR_PREP,            // pop start, end, step and push the loop counter, end, step
+    OP_FOR_ITER,            // [slot, symbol, target] bind the counter or jump to target when done
+    OP_FOR_STEP,            // advance the loop counter by its step
+    OP_JUMP,                // [target]
+    OP_JUMP_IF_FALSE,       // [target] pop the condition and jump if it is false
+    OP_POP,
+    OP_POP_N,               // [count]
+    OP_CALL,                // [argc, name, span] call the function below argc arguments, name is a symbol
+    OP_TAIL_CALL,           // [argc, name, span] same as OP_CALL, but a call to the running function restarts it
+    OP_RETURN,              // return the top of the stack from the current function
+    OP_END                  // finish the chunk with the top of the stack as its value
+};
+
+class FunctionPrototype {
+    public:
+        FuncDefNode* definition;
+        Chunk* chunk; // the body, owned by the prototype
+        FunctionPrototype(FuncDefNode* definition, Chunk* chunk);
+        FunctionPrototype(const FunctionPrototype&) = delete;
+        ~FunctionPrototype();
+};
+
+// A chunk is owned by the Arena of the tree it was compiled from, or for a
+// function body by its FunctionPrototype, so that it lives as long as any
+// Function running it
+
+class Chunk {
+    public:
+        // code range that evaluates a call's callee and arguments; errors raised
+        // inside it are reported at the outermost enclosing call, as visit_CallNode does
+        struct CallSite {
+            int start;
+            int end;
+            int span;
+        };
+        std::vector<uint8_t> code;
+        std::vector<Value> constants;
+        std::vector<FunctionPrototype*> functions;
+        std::vector<std::pair<Position, Position>> spans;
+        std::vector<CallSite> call_sites;
+        std::vector<bool> polymorphic; // by code offset, quickened operators that fell back; sized when the first one does
+        Chunk();
+        Chunk(const Chunk&) = delete;
+        ~Chunk();
+        void write(OpCode op);
+        void write_operand(uint32_t operand);
+        uint32_t read_operand(int offset) const;
+        void patch_operand(int offset, uint32_t operand);
+        int add_constant(Value value);
+        int add_span(Position pos_start, Position pos_end);
 };
 
+// ************COMPILER************
+
+class Compiler {
+    public:
+        struct Loop {
+            int stack_depth;
+            int continue_target;
+            std::vector<int> break_jumps;
+            std::vector<int> continue_jumps;
+            Loop(int stack_depth, int continue_target) : stack_depth(stack_depth), continue_target(continue_target) {}
+        };
+        Chunk* chunk;
+        int stack_depth = 0;
+        std::vector<Loop> loops;
+        Error* error;
+        Compiler();
+        std::pair<Chunk*, Error*> compile(Node* node);
+        void emit(OpCode op, int stack_effect);
+        void emit(OpCode op, int stack_effect, uint32_t operand);
+        void emit(OpCode op, int stack_effect, uint32_t operand1, uint32_t operand2);
+        void emit(OpCode op, int stack_effect, uint32_t operand1, uint32_t operand2, uint32_t operand3);
+        int emit_jump(OpCode op, int stack_effect);
+        void patch_jump(int operand_offset, int target);
+        int span(Node* node);
+        void compile_node(Node* node);
+        void compile_NumberNode(NumberNode* node);
+        void compile_StringNode(StringNode* node);
+        void compile_BinOpNode(BinOpNode* node);
+        void compile_UnaryOpNode(UnaryOpNode* node);
+        void compile_VarAccessNode(VarAccessNode* node);
+        void compile_VarAssignNode(VarAssignNode* node);
+        void compile_IfNode(IfNode* node);
+        void compile_ForNode(ForNode* node);
+        void compile_WhileNode(WhileNode* node);
+        void compile_FuncDefNode(FuncDefNode* node);
+        void compile_CallNode(CallNode* node);
+        void compile_ListNode(ListNode* node);
+        void compile_ReturnNode(ReturnNode* node);
+        void compile_ContinueNode(ContinueNode* node);
+        void compile_BreakNode(BreakNode* node);
+};
+
+// ************VIRTUAL MACHINE************
+
+class VM {
+    public:
+        std::vector<Value>& stack; // one of heap.stacks
+        VM();
+        VM(const VM&) = delete;
+        ~VM();
+        RuntimeResult run(Chunk* chunk, Context& context);
+        static std::pair<Value, Error*> binary_operation(OpCode op, Value left, Value right);
+        Error* locate_error(Chunk* chunk, int offset, Error* error);
+};
+
+// Quickening: once a binary operator instruction has run on two numbers, the
+// VM rewrites it in place into a form specialized for their types. _INT takes two integers,
+// _FLOAT two numbers of which at least one is a float (an integer is converted
+// just as the generic operator converts it) and _NUMBER any two numbers. A
+// specialized operator checks its operands and falls back to the generic one
+// when they don't fit, and from then on the operator stays generic.
+OpCode quicken(OpCode op, const Value& left, const Value& right);
+OpCode generic_operation(OpCode op);
+bool quick_operation(OpCode op, const Value& left, const Value& right, Value& result);
+
 // ************RUN************
-std::pair<Value*, Error*> run(std::string file_name, std::string text);
+extern bool use_ast_interpreter; // run the tree-walking Interpreter instead of the bytecode VM
+extern bool report_optimizations; // list what the Optimizer changed on stderr
+std::pair<Value, Error*> run(std::string file_name, std::string text);
+
+// A script that has been through the front end, ready to run any number of times
+struct Script {
+    int file_id;
+    Arena* arena; // owns the tree and its chunk
+    Node* ast;
+    bool optimized = false; // images are written from the tree before it is optimized
+};
+
+std::pair<Script, Error*> parse_script(std::string file_name, std::string text);
+std::pair<Value, Error*> execute(Script& script);
+int run_file(const std::string& path, const std::vector<std::string>& args);
+
+// ************SCRIPT CACHE************
+// Keeps the scripts run() has loaded, keyed by path and checked against the
+// file's modification time and size
+class ScriptCache {
+    public:
+        struct Entry {
+            std::filesystem::file_time_type mtime;
+            uintmax_t size;
+            Script script;
+        };
+        std::map<std::string, Entry> entries;
+        std::pair<Script*, Error*> load(const std::string& path);
+};
+
+extern ScriptCache script_cache;
+
+Error* precompile(const std::string& path);
+
+// ************IMAGES************
+// A precompiled script, written by vero --compile or next to any script
+// run() loads (path + "c"), so that loading it skips lexing and parsing.
+// Images are self-contained and can be run without their source.
+
+const char IMAGE_MAGIC[4] = {'V', 'E', 'R', 'O'};
+const uint32_t IMAGE_FORMAT_VERSION = 2;
+const uint8_t NULL_NODE_TAG = 0xFF;
+
+// How a serialized token's value is stored
+enum TokenValueTag : uint8_t {
+    SOURCE_TOKEN_VALUE, // the source between the token's positions
+    RANGE_TOKEN_VALUE, // some other range of the source
+    INLINE_TOKEN_VALUE // text that isn't in the source, stored after the tag
+};
+
+class ImageError : public Error {
+    public:
+        ImageError(std::string details);
+        std::string as_string() override;
+};
+
+uint64_t checksum(std::string_view data);
+bool is_image(std::string_view contents);
+
+class ImageWriter {
+    public:
+        std::string out;
+        std::string_view text; // the source the tree was parsed from
+        void write_u8(uint8_t value);
+        void write_varint(uint32_t value);
+        void write_u64(uint64_t value);
+        void write_position(const Position& position);
+        void write_token(const Token& token);
+        void write_node(Node* node);
+};
+
+class ImageReader {
+    public:
+        const char* data = nullptr;
+        const char* end = nullptr;
+        std::string_view text;
+        int file_id = 0;
+        bool failed = false;
+        uint8_t read_u8();
+        uint32_t read_varint();
+        Position read_position();
+        Token read_token();
+        Node* read_node();
+        Node* read_child();
+};
+
+bool write_image(const std::string& path, const Script& script);
+std::pair<Script, Error*> load_image(const std::string& path, std::string_view image, const std::string& source_path = "", std::string_view source = std::string_view());
+
+// ************MAPPED FILES************
+
+// The contents of a file, valid until it is destroyed
+class MappedFile {
+    public:
+        const char* data = nullptr;
+        size_t size = 0;
+        void* mapping = nullptr; // where the file is mapped, if it is
+        std::string buffer; // the file, on platforms without mmap
+        MappedFile() = default;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile();
+        bool open(const std::string& path);
+        std::string_view view() const;
+};
 
 std::string run_script_cpp(std::string script);
 
@@ -0,0 +1,56 @@
+// Heap traffic of running a script: how many times operator new is called
+// and how many bytes it hands out, on the VM and then on the tree-walking
+// interpreter. Only the run itself is counted, not loading the file.
+//
+//   bench_allocations script.vero ...
+
+#include "vero.h"
+#include <new>
+#include <cstdlib>
+#include <iomanip>
+#include <filesystem>
+
+size_t allocation_count = 0;
+size_t allocation_bytes = 0;
+
+void* operator new(size_t size) {
+    allocation_count++;
+    allocation_bytes += size;
+    if (void* memory = std::malloc(size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t size) noexcept {
+    std::free(memory);
+}
+
+int main(int argc, char* argv[]) {
+    initialize_global_symbol_table();
+    std::cout << "allocations, sizeof(Value) = " << sizeof(Value) << " bytes\n";
+    std::cout << std::fixed << std::setprecision(1);
+    for (int i = 1; i < argc; i++) {
+        std::ifstream file(argv[i]);
+        std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        for (bool ast : {false, true}) {
+            use_ast_interpreter = ast;
+            size_t count = allocation_count;
+            size_t bytes = allocation_bytes;
+            std::pair<Value, Error*> result = run(argv[i], text);
+            output_buffer.buffer.clear(); // what the script prints doesn't matter here
+            if (result.second != nullptr) {
+                std::cerr << result.second->as_string() << std::endl;
+                return 1;
+            }
+            std::cout << std::left << std::setw(24) << std::filesystem::path(argv[i]).filename().string() << std::right;
+            std::cout << (ast ? " AST " : " VM  ") << std::setw(8) << (allocation_bytes - bytes) / 1e6 << " MB ";
+            std::cout << std::setw(10) << allocation_count - count << " allocations\n";
+        }
+    }
+    return 0;
+}
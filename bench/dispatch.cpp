@@ -0,0 +1,92 @@
+// Cost of picking the visitor for a node: the chain of dynamic_casts the
+// Interpreter used to try in order, against the switch on Node::kind it uses
+// now. One node of each kind is dispatched ITERATIONS times.
+//
+//   bench_dispatch [iterations]
+
+#include "vero.h"
+#include <chrono>
+#include <iomanip>
+
+// The old order of Interpreter::visit, so later kinds pay for every failed cast before them
+__attribute__((noinline)) int cast_chain(Node* node) {
+    if (dynamic_cast<NumberNode*>(node)) return 0;
+    if (dynamic_cast<BinOpNode*>(node)) return 1;
+    if (dynamic_cast<UnaryOpNode*>(node)) return 2;
+    if (dynamic_cast<VarAccessNode*>(node)) return 3;
+    if (dynamic_cast<VarAssignNode*>(node)) return 4;
+    if (dynamic_cast<IfNode*>(node)) return 5;
+    if (dynamic_cast<ForNode*>(node)) return 6;
+    if (dynamic_cast<WhileNode*>(node)) return 7;
+    if (dynamic_cast<FuncDefNode*>(node)) return 8;
+    if (dynamic_cast<CallNode*>(node)) return 9;
+    if (dynamic_cast<StringNode*>(node)) return 10;
+    if (dynamic_cast<ListNode*>(node)) return 11;
+    if (dynamic_cast<ContinueNode*>(node)) return 12;
+    if (dynamic_cast<BreakNode*>(node)) return 13;
+    if (dynamic_cast<ReturnNode*>(node)) return 14;
+    return -1;
+}
+
+__attribute__((noinline)) int kind_switch(Node* node) {
+    switch (node->kind) {
+        case NUMBER_NODE: return 0;
+        case BIN_OP_NODE: return 1;
+        case UNARY_OP_NODE: return 2;
+        case VAR_ACCESS_NODE: return 3;
+        case VAR_ASSIGN_NODE: return 4;
+        case IF_NODE: return 5;
+        case FOR_NODE: return 6;
+        case WHILE_NODE: return 7;
+        case FUNC_DEF_NODE: return 8;
+        case CALL_NODE: return 9;
+        case STRING_NODE: return 10;
+        case LIST_NODE: return 11;
+        case CONTINUE_NODE: return 12;
+        case BREAK_NODE: return 13;
+        case RETURN_NODE: return 14;
+    }
+    return -1;
+}
+
+// Nanoseconds per call of dispatch on node
+double time_dispatch(int (*dispatch)(Node*), Node* node, long iterations) {
+    Node* volatile target = node;
+    volatile int sink = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; i++) {
+        sink = sink + dispatch(target);
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+int main(int argc, char* argv[]) {
+    long iterations = argc > 1 ? std::atol(argv[1]) : 20000000;
+    std::vector<std::pair<const char*, Node*>> nodes = {
+        {"NumberNode", new NumberNode()},
+        {"BinOpNode", new BinOpNode()},
+        {"UnaryOpNode", new UnaryOpNode()},
+        {"VarAccessNode", new VarAccessNode()},
+        {"VarAssignNode", new VarAssignNode()},
+        {"IfNode", new IfNode()},
+        {"ForNode", new ForNode()},
+        {"WhileNode", new WhileNode()},
+        {"FuncDefNode", new FuncDefNode()},
+        {"CallNode", new CallNode()},
+        {"StringNode", new StringNode()},
+        {"ListNode", new ListNode({}, Position(), Position())},
+        {"ContinueNode", new ContinueNode(Position(), Position())},
+        {"BreakNode", new BreakNode(Position(), Position())},
+        {"ReturnNode", new ReturnNode()},
+    };
+
+    std::cout << "dispatch, ns per node (" << iterations << " iterations)\n";
+    std::cout << std::left << std::setw(16) << "kind" << std::right << std::setw(12) << "dynamic_cast" << std::setw(10) << "switch" << "\n";
+    std::cout << std::fixed << std::setprecision(2);
+    for (std::pair<const char*, Node*>& node : nodes) {
+        std::cout << std::left << std::setw(16) << node.first << std::right;
+        std::cout << std::setw(12) << time_dispatch(cast_chain, node.second, iterations);
+        std::cout << std::setw(10) << time_dispatch(kind_switch, node.second, iterations) << "\n";
+    }
+    return 0;
+}
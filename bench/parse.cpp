@@ -0,0 +1,110 @@
+// Lexing and parsing time of generated scripts, best of RUNS runs, and how
+// many times the parser calls operator new. Each script repeats a function
+// with every kind of statement, and a call to it, until it is about the
+// given size; parse time should grow linearly with it.
+//
+//   bench_parse [megabytes ...]
+
+#include "vero.h"
+#include <new>
+#include <cstdlib>
+
+const int RUNS = 5;
+
+size_t allocation_count = 0;
+
+void* operator new(size_t size) {
+    allocation_count++;
+    if (void* memory = std::malloc(size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t size) noexcept {
+    std::free(memory);
+}
+
+std::string generate_script(size_t size) {
+    std::string text;
+    for (int i = 1; text.size() < size; i++) {
+        std::string n = std::to_string(i);
+        text += "func compute_" + n + "(alpha, beta) {\n"
+            "    let total = alpha * 2 + beta / 3 - 17.25\n"
+            "    if total > 100 and not (beta == 4) {\n"
+            "        let total = total - [1, 2, 3] / 0\n"
+            "    } elif total <= 5 {\n"
+            "        print(\"small value\\n\", total)\n"
+            "    } else {\n"
+            "        for k = 0 to 10 step 2 {\n"
+            "            let total = total + k ^ 2\n"
+            "        }\n"
+            "    }\n"
+            "    while total >= 1000 { let total = total / 2 }\n"
+            "    return total\n"
+            "}\n"
+            "let result_" + n + " = compute_" + n + "(" + n + ", " + std::to_string(i * 3) + ".5) # trailing comment\n";
+    }
+    return text;
+}
+
+int bench(double megabytes) {
+    std::string text = generate_script(megabytes * 1000000);
+
+    size_t tokens = 0;
+    size_t allocations = 0;
+    double lex_best = 1e9;
+    double parse_best = 1e9;
+    for (int run = 0; run < RUNS; run++) {
+        Lexer lexer = Lexer("<bench>", text);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::pair<std::vector<Token>, Error*> lexed = lexer.make_tokens();
+        std::chrono::steady_clock::time_point lexed_at = std::chrono::steady_clock::now();
+        if (lexed.second != nullptr) {
+            std::cerr << lexed.second->as_string() << std::endl;
+            return 1;
+        }
+        tokens = lexed.first.size();
+
+        Arena* arena = new Arena();
+        current_arena = arena;
+        size_t count = allocation_count;
+        std::chrono::steady_clock::time_point parse_start = std::chrono::steady_clock::now();
+        Parser parser = Parser(lexed.first);
+        ParseResult* ast = parser.parse();
+        std::chrono::steady_clock::time_point parsed_at = std::chrono::steady_clock::now();
+        allocations = allocation_count - count;
+        current_arena = nullptr;
+        if (ast->error != nullptr) {
+            std::cerr << ast->error->as_string() << std::endl;
+            return 1;
+        }
+        arena->release();
+
+        lex_best = std::min(lex_best, std::chrono::duration<double, std::milli>(lexed_at - start).count());
+        parse_best = std::min(parse_best, std::chrono::duration<double, std::milli>(parsed_at - parse_start).count());
+    }
+
+    std::cout << std::setw(6) << text.size() / 1000 << " KB " << std::setw(9) << tokens << " tokens: ";
+    std::cout << "lex " << std::setw(6) << lex_best << " ms, parse " << std::setw(6) << parse_best << " ms, ";
+    std::cout << std::setw(5) << parse_best * 1e6 / tokens << " ns/token, " << allocations << " parser allocations\n";
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "parse, best of " << RUNS << " runs\n";
+    if (argc == 1) {
+        return bench(1);
+    }
+    for (int i = 1; i < argc; i++) {
+        if (int status = bench(std::atof(argv[i]))) {
+            return status;
+        }
+    }
+    return 0;
+}
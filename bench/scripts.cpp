@@ -0,0 +1,65 @@
+// Wall time of running whole scripts through run(), on the VM and then on the
+// tree-walking interpreter, best of RUNS runs after one to warm up. A script
+// whose first line is "# work: <count> <unit>" also gets a rate, so
+// "# work: 15000000 nodes" prints nodes per second. Whatever the scripts
+// print is discarded.
+//
+//   bench_scripts script.vero ...
+
+#include "vero.h"
+#include <iomanip>
+#include <filesystem>
+
+const int RUNS = 5;
+
+// Seconds the run took, or -1 if it failed
+double time_run(const std::string& file_name, const std::string& text) {
+    std::ostringstream discard;
+    std::streambuf* output = std::cout.rdbuf(discard.rdbuf());
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::pair<Value, Error*> result = run(file_name, text);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    output_buffer.buffer.clear();
+    std::cout.rdbuf(output);
+    return result.second == nullptr ? seconds : -1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: bench_scripts script.vero ..." << std::endl;
+        return 1;
+    }
+    initialize_global_symbol_table();
+
+    std::cout << "scripts, best of " << RUNS << " runs\n" << std::fixed;
+    for (int i = 1; i < argc; i++) {
+        std::ifstream file(argv[i]);
+        std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        std::string script = std::filesystem::path(argv[i]).filename().string();
+        double work = 0;
+        std::string unit;
+        if (text.rfind("# work: ", 0) == 0) {
+            std::istringstream(text.substr(8, text.find('\n') - 8)) >> work >> unit;
+        }
+
+        for (bool ast : {false, true}) {
+            use_ast_interpreter = ast;
+            double best = time_run(argv[i], text);
+            for (int attempt = 0; attempt < RUNS && best >= 0; attempt++) {
+                double seconds = time_run(argv[i], text);
+                best = seconds < 0 ? seconds : std::min(best, seconds);
+            }
+            std::cout << std::left << std::setw(24) << script << std::right << (ast ? " AST " : " VM  ");
+            if (best < 0) {
+                std::cout << "   failed\n";
+                continue;
+            }
+            std::cout << std::setprecision(3) << std::setw(8) << best << " s";
+            if (work > 0) {
+                std::cout << std::setprecision(1) << std::setw(10) << work / best / 1e6 << " M " << unit << "/s";
+            }
+            std::cout << "\n";
+        }
+    }
+    return 0;
+}
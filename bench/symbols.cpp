@@ -0,0 +1,84 @@
+// Name lookup: resolves every identifier of a generated script full of
+// globals and functions to its symbol, best of RUNS passes, first through a
+// std::map like the one the Interner used to be and then through the
+// interpreter's own table.
+//
+//   bench_symbols [globals]
+
+#include "vero.h"
+
+const int RUNS = 20;
+
+std::string generate_script(int globals) {
+    std::string text;
+    for (int i = 0; i < globals; i++) {
+        std::string n = std::to_string(i);
+        std::string other = std::to_string(i * 7 % globals);
+        text += "let global_" + n + " = " + n + "\n"
+            "func function_" + n + "(argument) { return argument + global_" + n + " * global_" + other + " }\n"
+            "let global_" + other + " = function_" + n + "(global_" + n + ") + function_" + other + "(1)\n";
+    }
+    return text;
+}
+
+// The Interner before it became a hash table
+class MapInterner {
+    public:
+        std::map<std::string_view, int> symbols; // views into names
+        std::deque<std::string> names;
+        int intern(std::string_view name) {
+            std::map<std::string_view, int>::iterator it = symbols.find(name);
+            if (it != symbols.end()) {
+                return it->second;
+            }
+            names.push_back(std::string(name));
+            symbols.emplace(names.back(), names.size() - 1);
+            return names.size() - 1;
+        }
+};
+
+template <typename Lookup>
+double best_pass(const std::vector<std::string_view>& identifiers, Lookup lookup) {
+    double best = 1e9;
+    long checksum = 0; // keeps the lookups from being optimized away
+    for (int run = 0; run < RUNS; run++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (std::string_view name : identifiers) {
+            checksum += lookup(name);
+        }
+        best = std::min(best, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+    }
+    if (checksum == -1) {
+        std::cout << checksum;
+    }
+    return best / identifiers.size();
+}
+
+int main(int argc, char* argv[]) {
+    int globals = argc > 1 ? std::atoi(argv[1]) : 2000;
+    std::string text = generate_script(globals);
+    int file_id = register_source_file("<bench>", text);
+    Lexer lexer = Lexer(file_id);
+    std::pair<std::vector<Token>, Error*> lexed = lexer.make_tokens();
+    if (lexed.second != nullptr) {
+        std::cerr << lexed.second->as_string() << std::endl;
+        return 1;
+    }
+    std::vector<std::string_view> identifiers;
+    for (const Token& token : lexed.first) {
+        if (token.type == IDENTIFIER_TOKEN) {
+            identifiers.push_back(token.value);
+        }
+    }
+
+    initialize_global_symbol_table();
+    MapInterner map_interner;
+    double map_time = best_pass(identifiers, [&](std::string_view name) { return map_interner.intern(name); });
+    double table_time = best_pass(identifiers, [&](std::string_view name) { return global_symbol_table.symbol(name); });
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "symbols, " << globals << " globals and functions, " << identifiers.size() << " identifiers, ";
+    std::cout << map_interner.names.size() << " names, best of " << RUNS << " passes\n";
+    std::cout << "  std::map " << map_time << " ns, hash table " << table_time << " ns per identifier\n";
+    return 0;
+}
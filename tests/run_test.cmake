@@ -0,0 +1,35 @@
+# Runs one script of the test corpus and compares everything it prints,
+# errors included, with the script's .out file. The script runs twice in a
+# fresh copy of the corpus: the first run parses it and saves its image, the
+# second loads that image, and both must print the same thing. A script that
+# reads input gets its .in file on stdin, and an empty one otherwise.
+#
+#   cmake -DVERO=<binary> -DNAME=<script> -DMODE=vm|ast -DTESTS_DIR=<dir> -DWORK_DIR=<dir> -P run_test.cmake
+
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(COPY "${TESTS_DIR}/" DESTINATION "${WORK_DIR}" FILES_MATCHING PATTERN "*.vero")
+file(READ "${TESTS_DIR}/${NAME}.out" expected)
+
+set(options)
+if(MODE STREQUAL "ast")
+    set(options --ast)
+endif()
+
+set(input "${TESTS_DIR}/${NAME}.in")
+if(NOT EXISTS "${input}")
+    set(input /dev/null)
+endif()
+
+foreach(run parsed image)
+    execute_process(
+        COMMAND "${VERO}" ${options} "${NAME}.vero"
+        WORKING_DIRECTORY "${WORK_DIR}"
+        INPUT_FILE "${input}"
+        OUTPUT_VARIABLE output
+        ERROR_VARIABLE output
+        TIMEOUT 60
+    )
+    if(NOT output STREQUAL expected)
+        message(FATAL_ERROR "${NAME}.vero (${MODE}, ${run}) printed:\n${output}\nexpected:\n${expected}")
+    endif()
+endforeach()